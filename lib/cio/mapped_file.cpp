@@ -0,0 +1,251 @@
+#include "mapped_file.hpp"
+
+#include "cio.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cio
+{
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+	: m_data(std::exchange(other.m_data, nullptr))
+	, m_size(std::exchange(other.m_size, 0))
+	, m_open(std::exchange(other.m_open, false))
+	, m_mapping(std::exchange(other.m_mapping, nullptr))
+	, m_buffer(std::move(other.m_buffer))
+{ }
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+		m_open = std::exchange(other.m_open, false);
+		m_mapping = std::exchange(other.m_mapping, nullptr);
+		m_buffer = std::move(other.m_buffer);
+	}
+
+	return *this;
+}
+
+#ifdef _WIN32
+
+bool stat_file(const char* filename, file_info& info)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+	if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes))
+		return false;
+
+	if (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		return false;
+
+	info.size = (std::uint64_t(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+	info.mtime = std::int64_t((std::uint64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32)
+	                         | attributes.ftLastWriteTime.dwLowDateTime);
+
+	return true;
+}
+
+bool mapped_file::open(const char* filename)
+{
+	close();
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+	                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	// Empty files can't be mapped, but are still valid
+	if (size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		m_open = true;
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+	if (mapping)
+		CloseHandle(mapping);
+
+	if (!view)
+		return read_whole(filename);
+
+	m_mapping = view;
+	m_data = static_cast<const char*>(view);
+	m_size = std::size_t(size.QuadPart);
+	m_open = true;
+
+	return true;
+}
+
+std::size_t mapped_file::resident_size() const
+{
+	return m_size;
+}
+
+void mapped_file::close()
+{
+	if (m_mapping)
+		UnmapViewOfFile(m_mapping);
+
+	m_mapping = nullptr;
+	m_buffer.reset();
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+#else
+
+bool stat_file(const char* filename, file_info& info)
+{
+	struct stat st;
+
+	if (::stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+		return false;
+
+	info.size = std::uint64_t(st.st_size);
+	info.mtime = std::int64_t(st.st_mtime);
+
+	return true;
+}
+
+bool mapped_file::open(const char* filename)
+{
+	close();
+
+	int fd = ::open(filename, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		::close(fd);
+		return read_whole(filename);
+	}
+
+	// Empty files can't be mapped, but are still valid
+	if (st.st_size == 0)
+	{
+		::close(fd);
+		m_open = true;
+		return true;
+	}
+
+	void* view = mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (view == MAP_FAILED)
+		return read_whole(filename);
+
+	m_mapping = view;
+	m_data = static_cast<const char*>(view);
+	m_size = std::size_t(st.st_size);
+	m_open = true;
+
+	return true;
+}
+
+std::size_t mapped_file::resident_size() const
+{
+	if (!m_mapping)
+		return m_size;
+
+#ifdef __linux__
+	using mincore_vec_t = unsigned char;
+#else
+	using mincore_vec_t = char;
+#endif
+
+	std::size_t page_size = std::size_t(sysconf(_SC_PAGESIZE));
+	std::vector<mincore_vec_t> pages((m_size + page_size - 1) / page_size);
+
+	if (mincore(m_mapping, m_size, pages.data()) != 0)
+		return m_size;
+
+	std::size_t resident = 0;
+
+	for (auto page : pages)
+	{
+		if (page & 1)
+			resident += page_size;
+	}
+
+	return std::min(resident, m_size);
+}
+
+void mapped_file::close()
+{
+	if (m_mapping)
+		munmap(m_mapping, m_size);
+
+	m_mapping = nullptr;
+	m_buffer.reset();
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+#endif
+
+bool mapped_file::read_whole(const char* filename)
+{
+	stream file(filename, stream::mode_read);
+
+	if (!file || !file.seek_reverse(0))
+		return false;
+
+	long size = file.tell();
+
+	if (size < 0 || !file.seek(0))
+		return false;
+
+	m_buffer = std::make_unique<char[]>(std::size_t(size) + 1);
+
+	if (file.read(m_buffer.get(), std::size_t(size)) != std::size_t(size))
+	{
+		m_buffer.reset();
+		return false;
+	}
+
+	m_data = m_buffer.get();
+	m_size = std::size_t(size);
+	m_open = true;
+
+	return true;
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef CIO_MAPPED_FILE_HPP
+#define CIO_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace cio
+{
+
+struct file_info
+{
+	std::uint64_t size = 0;
+
+	// Last modified time, in platform specific units
+	std::int64_t mtime = 0;
+};
+
+// Returns false if the file doesn't exist or isn't a regular file
+bool stat_file(const char* filename, file_info& info);
+
+// Read-only view of a whole file, memory mapped where the platform allows it
+// Files which can't be mapped are read in to memory instead
+// The view stays at the same address when a mapped_file is moved
+class mapped_file
+{
+	private:
+		const char* m_data = nullptr;
+		std::size_t m_size = 0;
+		bool m_open = false;
+
+		// Set if the view is a mapping rather than m_buffer
+		void* m_mapping = nullptr;
+		std::unique_ptr<char[]> m_buffer;
+
+		bool read_whole(const char* filename);
+
+	public:
+		mapped_file() = default;
+
+		explicit mapped_file(const char* filename)
+		{
+			open(filename);
+		}
+
+		mapped_file(mapped_file&& other) noexcept;
+		mapped_file& operator=(mapped_file&& other) noexcept;
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		~mapped_file()
+		{
+			close();
+		}
+
+		bool open(const char* filename);
+		void close();
+
+		bool is_open() const
+		{
+			return m_open;
+		}
+
+		explicit operator bool() const
+		{
+			return m_open;
+		}
+
+		const char* data() const
+		{
+			return m_data;
+		}
+
+		std::size_t size() const
+		{
+			return m_size;
+		}
+
+		std::string_view view() const
+		{
+			return {m_data, m_size};
+		}
+
+		// Bytes of the view currently in physical memory
+		// Files read in to memory count in full, as does a mapping on platforms where it can't be checked
+		std::size_t resident_size() const;
+};
+
+}
+
+#endif // CIO_MAPPED_FILE_HPP
@@ -0,0 +1,183 @@
+#ifndef EO_UTIL_FUNCTION_HPP
+#define EO_UTIL_FUNCTION_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// std::function replacement which stores small callables in place instead of on the heap
+// Anything up to Size bytes, such as a lambda capturing this and a member function pointer,
+// is never allocated
+
+namespace util
+{
+	template <class T, std::size_t Size = 4 * sizeof(void*)> class function;
+
+	template <class R, class... Args, std::size_t Size> class function<R(Args...), Size>
+	{
+		private:
+			struct ops_t
+			{
+				R (*invoke)(void* storage, Args... args);
+				void (*copy)(void* dest, const void* src);
+				void (*move)(void* dest, void* src) noexcept;
+				void (*destroy)(void* storage) noexcept;
+			};
+
+			template <class F> struct inline_ops
+			{
+				static F& get(void* p) { return *static_cast<F*>(p); }
+
+				static R invoke(void* p, Args... args)
+				{
+					return get(p)(std::forward<Args>(args)...);
+				}
+
+				static void copy(void* dest, const void* src)
+				{
+					new (dest) F(*static_cast<const F*>(src));
+				}
+
+				static void move(void* dest, void* src) noexcept
+				{
+					new (dest) F(std::move(get(src)));
+					get(src).~F();
+				}
+
+				static void destroy(void* p) noexcept
+				{
+					get(p).~F();
+				}
+
+				static constexpr ops_t table = {invoke, copy, move, destroy};
+			};
+
+			template <class F> struct heap_ops
+			{
+				static F*& get(void* p) { return *static_cast<F**>(p); }
+
+				static R invoke(void* p, Args... args)
+				{
+					return (*get(p))(std::forward<Args>(args)...);
+				}
+
+				static void copy(void* dest, const void* src)
+				{
+					new (dest) F*(new F(**static_cast<F* const*>(src)));
+				}
+
+				static void move(void* dest, void* src) noexcept
+				{
+					new (dest) F*(get(src));
+				}
+
+				static void destroy(void* p) noexcept
+				{
+					delete get(p);
+				}
+
+				static constexpr ops_t table = {invoke, copy, move, destroy};
+			};
+
+			template <class F>
+			static constexpr bool fits_inline = sizeof(F) <= Size
+			                                 && alignof(F) <= alignof(std::max_align_t)
+			                                 && std::is_nothrow_move_constructible_v<F>;
+
+			alignas(std::max_align_t) unsigned char m_storage[Size];
+			const ops_t* m_ops = nullptr;
+
+			void reset() noexcept
+			{
+				if (m_ops)
+				{
+					m_ops->destroy(m_storage);
+					m_ops = nullptr;
+				}
+			}
+
+		public:
+			function() noexcept = default;
+
+			template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, function>>>
+			function(F&& f)
+			{
+				using Fn = std::decay_t<F>;
+
+				if constexpr (fits_inline<Fn>)
+				{
+					new (m_storage) Fn(std::forward<F>(f));
+					m_ops = &inline_ops<Fn>::table;
+				}
+				else
+				{
+					new (m_storage) Fn*(new Fn(std::forward<F>(f)));
+					m_ops = &heap_ops<Fn>::table;
+				}
+			}
+
+			function(const function& other)
+				: m_ops(other.m_ops)
+			{
+				if (m_ops)
+					m_ops->copy(m_storage, other.m_storage);
+			}
+
+			function(function&& other) noexcept
+				: m_ops(other.m_ops)
+			{
+				if (m_ops)
+				{
+					m_ops->move(m_storage, other.m_storage);
+					other.m_ops = nullptr;
+				}
+			}
+
+			function& operator=(const function& other)
+			{
+				if (this != &other)
+				{
+					function copy(other);
+					*this = std::move(copy);
+				}
+
+				return *this;
+			}
+
+			function& operator=(function&& other) noexcept
+			{
+				if (this != &other)
+				{
+					reset();
+
+					if (other.m_ops)
+					{
+						other.m_ops->move(m_storage, other.m_storage);
+						m_ops = other.m_ops;
+						other.m_ops = nullptr;
+					}
+				}
+
+				return *this;
+			}
+
+			~function()
+			{
+				reset();
+			}
+
+			explicit operator bool() const noexcept
+			{
+				return m_ops != nullptr;
+			}
+
+			R operator()(Args... args) const
+			{
+				// Like std::function, calling through const doesn't make the callable const
+				return m_ops->invoke(const_cast<unsigned char*>(m_storage), std::forward<Args>(args)...);
+			}
+	};
+}
+
+#endif // EO_UTIL_FUNCTION_HPP
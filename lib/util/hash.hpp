@@ -0,0 +1,24 @@
+#ifndef EO_UTIL_HASH_HPP
+#define EO_UTIL_HASH_HPP
+
+#include <cstdint>
+#include <string_view>
+
+namespace util
+{
+	constexpr std::uint64_t fnv1a_64_basis = 0xCBF29CE484222325ULL;
+
+	// 64-bit FNV-1a, pass a previous result as hash to continue it over more data
+	constexpr std::uint64_t fnv1a_64(std::string_view data, std::uint64_t hash = fnv1a_64_basis) noexcept
+	{
+		for (unsigned char c : data)
+		{
+			hash ^= c;
+			hash *= 0x100000001B3ULL;
+		}
+
+		return hash;
+	}
+}
+
+#endif // EO_UTIL_HASH_HPP
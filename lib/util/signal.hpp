@@ -1,52 +1,350 @@
 #ifndef EO_UTIL_SIGNAL_HPP
 #define EO_UTIL_SIGNAL_HPP
 
-#include <functional>
-#include <list>
+#include "function.hpp"
+
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
-// Minimalist sigc::signal replacement, without slots (disconnection) or return values.
+// Minimalist sigc::signal replacement, without return values
+// Slots are kept in a vector and stored with util::function, so connecting a small
+// lambda only allocates when the vector grows
+//
+// signal<Sig> may only be used from one thread at a time
+// signal<Sig, thread_safe> may be connected to, disconnected from and emitted from any thread
+// It copies its slot list on change, so emitting takes a lock only long enough to grab the current list
+// A slot disconnected from another thread may still be called by an emission already in progress
 
 namespace util
 {
-	template <class T> class signal;
+	struct single_threaded { };
+	struct thread_safe { };
+
+	namespace detail
+	{
+		class signal_core_base
+		{
+			public:
+				virtual ~signal_core_base() = default;
+				virtual void disconnect(std::uint64_t id) = 0;
+				virtual bool connected(std::uint64_t id) const = 0;
+		};
+	}
+
+	// Refers to a connected slot, doesn't disconnect it when destroyed
+	// Safe to use after the signal is gone
+	class connection
+	{
+		private:
+			std::weak_ptr<detail::signal_core_base> m_core;
+			std::uint64_t m_id = 0;
+
+		public:
+			connection() = default;
+
+			connection(std::weak_ptr<detail::signal_core_base> core, std::uint64_t id)
+				: m_core(std::move(core))
+				, m_id(id)
+			{ }
+
+			void disconnect()
+			{
+				if (auto core = m_core.lock())
+					core->disconnect(m_id);
+
+				m_core.reset();
+			}
+
+			bool connected() const
+			{
+				auto core = m_core.lock();
+				return core && core->connected(m_id);
+			}
+	};
+
+	// Disconnects its slot when destroyed
+	class scoped_connection
+	{
+		private:
+			connection m_connection;
+
+		public:
+			scoped_connection() = default;
 
-	template <class R, class... Args> class signal<R(Args...)>
+			scoped_connection(connection c)
+				: m_connection(std::move(c))
+			{ }
+
+			scoped_connection(scoped_connection&&) = default;
+
+			scoped_connection& operator=(scoped_connection&& other)
+			{
+				if (this != &other)
+				{
+					m_connection.disconnect();
+					m_connection = std::move(other.m_connection);
+					other.m_connection = {};
+				}
+
+				return *this;
+			}
+
+			// no copy/assign
+			scoped_connection(const scoped_connection&) = delete;
+			const scoped_connection& operator=(const scoped_connection&) = delete;
+
+			~scoped_connection()
+			{
+				m_connection.disconnect();
+			}
+
+			void disconnect()
+			{
+				m_connection.disconnect();
+			}
+
+			bool connected() const
+			{
+				return m_connection.connected();
+			}
+
+			// Keeps the slot connected after this is destroyed
+			connection release()
+			{
+				return std::exchange(m_connection, {});
+			}
+	};
+
+	template <class T, class Mode = single_threaded> class signal;
+
+	template <class R, class... Args, class Mode> class signal<R(Args...), Mode>
 	{
 		static_assert(std::is_same<R, void>::value, "Return type must be void");
 
+		public:
+			using slot_type = util::function<R(Args...)>;
+
 		private:
-			std::mutex m_mutex;
-			std::list<std::function<R(Args...)>> m_slots;
+			struct slot_t
+			{
+				// 0 once disconnected
+				std::uint64_t id;
+				slot_type fn;
+			};
+
+			// Slots connected during an emission wait in m_pending, so m_slots is never
+			// reallocated under a running slot. Disconnected slots are removed once it finishes
+			struct core_t : detail::signal_core_base
+			{
+				std::vector<slot_t> m_slots;
+				std::vector<slot_t> m_pending;
+				std::uint64_t m_next_id = 1;
+				int m_emitting = 0;
+				bool m_dirty = false;
+
+				std::uint64_t connect(slot_type&& fn)
+				{
+					auto&& slots = m_emitting ? m_pending : m_slots;
+					slots.push_back({m_next_id, std::move(fn)});
+					return m_next_id++;
+				}
+
+				void disconnect(std::uint64_t id) override
+				{
+					for (auto* slots : {&m_slots, &m_pending})
+					{
+						for (auto it = slots->begin(); it != slots->end(); ++it)
+						{
+							if (it->id != id)
+								continue;
+
+							if (m_emitting && slots == &m_slots)
+							{
+								it->id = 0;
+								m_dirty = true;
+							}
+							else
+							{
+								slots->erase(it);
+							}
+
+							return;
+						}
+					}
+				}
+
+				bool connected(std::uint64_t id) const override
+				{
+					for (auto* slots : {&m_slots, &m_pending})
+					{
+						for (auto&& slot : *slots)
+						{
+							if (slot.id == id)
+								return true;
+						}
+					}
+
+					return false;
+				}
+
+				bool empty() const
+				{
+					return m_slots.empty() && m_pending.empty();
+				}
+
+				template <class... CallArgs>
+				void emit(CallArgs&&... args)
+				{
+					++m_emitting;
+
+					for (std::size_t i = 0, n = m_slots.size(); i < n; ++i)
+					{
+						auto&& slot = m_slots[i];
+
+						if (slot.id != 0)
+							slot.fn(args...);
+					}
+
+					if (--m_emitting == 0)
+						finish_emit();
+				}
+
+				void finish_emit()
+				{
+					if (m_dirty)
+					{
+						std::size_t live = 0;
+
+						for (auto&& slot : m_slots)
+						{
+							if (slot.id != 0)
+								m_slots[live++] = std::move(slot);
+						}
+
+						m_slots.erase(m_slots.begin() + live, m_slots.end());
+						m_dirty = false;
+					}
+
+					for (auto&& slot : m_pending)
+						m_slots.push_back(std::move(slot));
+
+					m_pending.clear();
+				}
+			};
+
+			// Copy-on-write: a slot list is never changed once published
+			struct ts_core_t : detail::signal_core_base
+			{
+				using slot_list = std::vector<slot_t>;
+
+				mutable std::mutex m_mutex;
+				std::shared_ptr<const slot_list> m_slots = std::make_shared<slot_list>();
+				std::uint64_t m_next_id = 1;
+
+				std::uint64_t connect(slot_type&& fn)
+				{
+					std::unique_lock lock(m_mutex);
+
+					auto slots = std::make_shared<slot_list>();
+					slots->reserve(m_slots->size() + 1);
+					*slots = *m_slots;
+					slots->push_back({m_next_id, std::move(fn)});
+
+					m_slots = std::move(slots);
+					return m_next_id++;
+				}
+
+				void disconnect(std::uint64_t id) override
+				{
+					std::unique_lock lock(m_mutex);
+
+					auto slots = std::make_shared<slot_list>();
+					slots->reserve(m_slots->size());
+
+					for (auto&& slot : *m_slots)
+					{
+						if (slot.id != id)
+							slots->push_back(slot);
+					}
+
+					m_slots = std::move(slots);
+				}
+
+				bool connected(std::uint64_t id) const override
+				{
+					std::unique_lock lock(m_mutex);
+
+					for (auto&& slot : *m_slots)
+					{
+						if (slot.id == id)
+							return true;
+					}
+
+					return false;
+				}
+
+				bool empty() const
+				{
+					std::unique_lock lock(m_mutex);
+					return m_slots->empty();
+				}
+
+				template <class... CallArgs>
+				void emit(CallArgs&&... args)
+				{
+					std::shared_ptr<const slot_list> slots;
+
+					{
+						std::unique_lock lock(m_mutex);
+						slots = m_slots;
+					}
+
+					for (auto&& slot : *slots)
+						slot.fn(args...);
+				}
+			};
+
+			static constexpr bool is_thread_safe = std::is_same<Mode, thread_safe>::value;
+
+			using core_type = std::conditional_t<is_thread_safe, ts_core_t, core_t>;
+
+			// Created on first connect, except in thread safe mode where that would race
+			std::shared_ptr<core_type> m_core;
 
 		public:
-			signal() = default;
+			signal()
+			{
+				if constexpr (is_thread_safe)
+					m_core = std::make_shared<core_type>();
+			}
 
 			// no copy/move/assign
 			signal(const signal&) = delete;
 			const signal& operator=(const signal&) = delete;
 
-			void connect(std::function<R(Args...)>&& fn)
+			connection connect(slot_type fn)
 			{
-				//std::unique_lock lock(m_mutex);
-				m_slots.push_back(std::move(fn));
+				if (!m_core)
+					m_core = std::make_shared<core_type>();
+
+				std::uint64_t id = m_core->connect(std::move(fn));
+				return {m_core, id};
 			}
 
-			void connect(const std::function<R(Args...)>& fn)
+			bool empty() const
 			{
-				//std::unique_lock lock(m_mutex);
-				m_slots.push_back(fn);
+				return !m_core || m_core->empty();
 			}
 
 			template <class... CallArgs>
 			void operator()(CallArgs&&... args) const
 			{
-				//std::unique_lock lock(m_mutex);
-
-				for (auto&& slot : m_slots)
-					slot(std::forward<CallArgs>(args)...);
+				if (m_core)
+					m_core->emit(std::forward<CallArgs>(args)...);
 			}
 	};
 }
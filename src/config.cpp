@@ -6,33 +6,49 @@
 #include <allegro5/allegro.h>
 
 #include <charconv>
+#include <cstddef>
+#include <limits>
 #include <string_view>
 
 // Default configuration settings
 Config::Config()
 	: Host("game.eoserv.net")
 	, Port("8078")
+	, PingInterval(0)
+	, CaptureFile("")
 	, Fullscreen(false)
 	, Sizeable(false)
 	, DrawEngine("allegro")
 	, DrawAccel(true)
+	, GraphicsCacheSize(128 * 1024 * 1024)
+	, GraphicsIndex("gfx/eoref.idx")
+	, GraphicsPack("gfx/egf.pack")
+	, GraphicsLoaderThreads(2)
+	, GraphicsColorKey("000000")
+	, MemoryStatsFile("")
+	, MemoryStatsInterval(60)
 { }
 
 static ALLEGRO_CONFIG* g_al_config;
 
 Config g_config;
 
-static int parse_numeric(std::string_view str)
+// Values too large for T are clamped to its maximum
+template <class T>
+static T parse_numeric(std::string_view str)
 {
 	namespace ascii = util::ascii;
 
-	int value = 0;
+	T value = 0;
 
 	auto&& first = &str[0];
 	auto&& last = first + str.size();
 
 	auto result = std::from_chars(first, last, value);
 
+	if (result.ec == std::errc::result_out_of_range)
+		return std::numeric_limits<T>::max();
+
 	if (result.ec == std::errc{})
 	{
 		const char* p = result.ptr;
@@ -45,13 +61,22 @@ static int parse_numeric(std::string_view str)
 		if (p < last)
 		{
 			std::string_view unit_str(p);
+			T multiplier = 1;
 
 			if (ascii::stricmp(unit_str, "kB") == 0 || ascii::stricmp(unit_str, "KiB") == 0)
-				value *= 1024;
+				multiplier = 1024;
 			else if (ascii::stricmp(unit_str, "MB") == 0 || ascii::stricmp(unit_str, "MiB") == 0)
-				value *= 1024 * 1024;
+				multiplier = 1024 * 1024;
 			else if (ascii::stricmp(unit_str, "GB") == 0 || ascii::stricmp(unit_str, "GiB") == 0)
-				value *= 1024 * 1024 * 1024;
+				multiplier = 1024 * 1024 * 1024;
+
+			if (value > std::numeric_limits<T>::max() / multiplier)
+				return std::numeric_limits<T>::max();
+
+			if (value < std::numeric_limits<T>::min() / multiplier)
+				return std::numeric_limits<T>::min();
+
+			value *= multiplier;
 		}
 	}
 
@@ -85,7 +110,11 @@ void eo_init_config()
 		},
 		[](int& out, std::string_view str)
 		{
-			out = parse_numeric(str);
+			out = parse_numeric<int>(str);
+		},
+		[](std::size_t& out, std::string_view str)
+		{
+			out = parse_numeric<std::size_t>(str);
 		}
 	);
 
@@ -126,6 +155,10 @@ void eo_init_config()
 						parse_config_entry(g_config.Host, entry);
 					else if (ascii::stricmp(entry_name_str, "Port") == 0)
 						parse_config_entry(g_config.Port, entry);
+					else if (ascii::stricmp(entry_name_str, "PingInterval") == 0)
+						parse_config_entry(g_config.PingInterval, entry);
+					else if (ascii::stricmp(entry_name_str, "CaptureFile") == 0)
+						parse_config_entry(g_config.CaptureFile, entry);
 					break;
 
 				case section_configuration:
@@ -140,6 +173,20 @@ void eo_init_config()
 						parse_config_entry(g_config.DrawEngine, entry);
 					else if (ascii::stricmp(entry_name_str, "DrawAccel") == 0)
 						parse_config_entry(g_config.DrawAccel, entry);
+					else if (ascii::stricmp(entry_name_str, "GraphicsCacheSize") == 0)
+						parse_config_entry(g_config.GraphicsCacheSize, entry);
+					else if (ascii::stricmp(entry_name_str, "GraphicsIndex") == 0)
+						parse_config_entry(g_config.GraphicsIndex, entry);
+					else if (ascii::stricmp(entry_name_str, "GraphicsPack") == 0)
+						parse_config_entry(g_config.GraphicsPack, entry);
+					else if (ascii::stricmp(entry_name_str, "GraphicsLoaderThreads") == 0)
+						parse_config_entry(g_config.GraphicsLoaderThreads, entry);
+					else if (ascii::stricmp(entry_name_str, "GraphicsColorKey") == 0)
+						parse_config_entry(g_config.GraphicsColorKey, entry);
+					else if (ascii::stricmp(entry_name_str, "MemoryStatsFile") == 0)
+						parse_config_entry(g_config.MemoryStatsFile, entry);
+					else if (ascii::stricmp(entry_name_str, "MemoryStatsInterval") == 0)
+						parse_config_entry(g_config.MemoryStatsInterval, entry);
 					break;
 
 				case section_settings:
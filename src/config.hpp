@@ -1,12 +1,16 @@
 #ifndef EO_CONFIG_HPP
 #define EO_CONFIG_HPP
 
+#include <cstddef>
+
 // Unsupported / unused configuration values are commented out
 struct Config
 {
 	// [CONNECTION]
 	const char* Host;
 	const char* Port;
+	int PingInterval; // eoref extension: latency probe interval in ms, 0 = off
+	const char* CaptureFile; // eoref extension: session capture path, empty = off
 
 	// [CONFIGURATION]
 	bool Fullscreen;
@@ -16,6 +20,13 @@ struct Config
 	// [ENGINE]
 	const char* DrawEngine;
 	bool DrawAccel;
+	std::size_t GraphicsCacheSize; // eoref extension: memory for loaded graphics, with units (eg. 128 MB), 0 = off
+	const char* GraphicsIndex; // eoref extension: where the EGF bitmap tables are saved between runs, empty = off
+	const char* GraphicsPack; // eoref extension: archive of pre-decoded graphics made by egf_pack, empty = off
+	int GraphicsLoaderThreads; // eoref extension: threads decoding graphics ahead of use, 0 = load on demand only
+	const char* GraphicsColorKey; // eoref extension: RRGGBB hex color decoded as transparent, none = off
+	const char* MemoryStatsFile; // eoref extension: file Data::memory_stats() is appended to as JSON lines, empty = off
+	int MemoryStatsInterval; // eoref extension: seconds between memory stats lines
 	//int MaxFPS;
 
 	// [SETTINGS]
@@ -1,96 +1,877 @@
 #include "data.hpp"
 
-#include "cio/cio.hpp"
+#include "config.hpp"
+#include "data/dib_reader.hpp"
+#include "data/full_emf.hpp"
 #include "data/pe_reader.hpp"
+#include "util/ascii.hpp"
+#include "util/hash.hpp"
 #include "util/int_pack.hpp"
 
+#include "cio/cio.hpp"
+
 #include "trace.hpp"
 
 #include "fmt/core.h"
 
 #include <algorithm>
-#include <array>
-#include <vector>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 #define TRACE_CTX "data"
 
 static constexpr int EGF_MAX = 25;
 
+// Bitmap resource ids are offset from the graphic numbers used by the pub and map files
+static constexpr int EGF_RESOURCE_BASE = 100;
+
+// The EGF each map graphic layer is drawn from
+static constexpr int map_layer_egf[9] = {3, 4, 5, 6, 6, 7, 3, 22, 5};
+
+static constexpr int NPC_EGF = 21;
+static constexpr int NPC_FRAMES = 40;
+
+// Pixels uploaded per frame from the loader, so a burst of finished images is spread out
+static constexpr std::size_t upload_budget = 4 * 1024 * 1024;
+
+// Frame numbers go in the cache key above the egf id, which fits in 8 bits
+static constexpr int frame_shift = 40;
+static constexpr std::size_t max_frames = 0xFFFFFF;
+
+static std::uint64_t graphic_key(int egf_id, int id)
+{
+	return (std::uint64_t(std::uint32_t(egf_id)) << 32) | std::uint32_t(id);
+}
+
+static std::string egf_filename(int egf_id)
+{
+	return fmt::format("gfx/gfx{:03}.egf", egf_id);
+}
+
+static std::optional<pe_reader::BitmapInfo> find_bitmap(const Data::EGF& egf, int id)
+{
+	if (egf.index_table)
+		return egf.index_table->find(id);
+
+	if (auto info = pe_reader::find(egf.bitmap_table, id))
+		return *info;
+
+	return std::nullopt;
+}
+
+// Parses an RRGGBB hex color, "none" or an empty string turns the key off
+// Anything else falls back to black, the key EO's graphics are drawn with
+static std::optional<std::uint32_t> parse_color_key(std::string_view str)
+{
+	if (str.empty() || util::ascii::stricmp(str, "none") == 0)
+		return std::nullopt;
+
+	std::uint32_t key = 0;
+	auto result = std::from_chars(str.data(), str.data() + str.size(), key, 16);
+
+	if (str.size() != 6 || result.ec != std::errc{} || result.ptr != str.data() + str.size())
+	{
+		trace_log("GraphicsColorKey " << str << " is not an RRGGBB color, using 000000");
+		return 0x000000U;
+	}
+
+	return key;
+}
+
+Data::Data()
+	: m_egfs(EGF_MAX)
+	, m_graphic_cache(g_config.GraphicsCacheSize)
+	, m_color_key(parse_color_key(g_config.GraphicsColorKey))
+{
+	// Prefetched graphics only stay loaded in the cache
+	if (g_config.GraphicsLoaderThreads > 0 && g_config.GraphicsCacheSize > 0)
+	{
+		m_loader = std::make_unique<Graphic_Loader>(
+			[this](std::uint64_t key, Graphic_Loader::Image& image) { return decode(key, image); },
+			g_config.GraphicsLoaderThreads
+		);
+	}
+}
+
+Data::~Data()
+{
+	// Workers may be in the middle of reading EGF data
+	m_loader.reset();
+
+	if (m_index_stale)
+		save_index();
+}
+
 void Data::load_all_data()
 {
-	m_egfs.reserve(EGF_MAX);
+	// Opened first, as each EGF is checked against it when it's opened
+	trace_log("DIB converters use " << dib_converter_isa());
+
+	if (g_config.GraphicsPack[0] != '\0' && m_archive.open(g_config.GraphicsPack))
+	{
+		// Keyed pixels were baked in to the archive when it was packed
+		if (m_archive.color_key() == m_color_key)
+		{
+			trace_log(g_config.GraphicsPack << " has " << m_archive.size() << " graphics");
+		}
+		else
+		{
+			trace_log(g_config.GraphicsPack << " was packed with a different color key");
+			m_archive.close();
+		}
+	}
+
+	bool use_index = g_config.GraphicsIndex[0] != '\0';
+	bool index_dirty = false;
+
+	if (use_index && !m_index.open(g_config.GraphicsIndex))
+		index_dirty = true;
 
 	for (int id = 1; id <= EGF_MAX; ++id)
 	{
-		auto&& fname = fmt::format("gfx/gfx{:03}.egf", id);
-		cio::stream f(fname.c_str());
+		auto&& egf = m_egfs[id - 1];
+		egf.id = id;
+
+		cio::file_info info;
 
-		if (f)
+		if (!cio::stat_file(egf_filename(id).c_str(), info))
 		{
-			auto&& pe = pe_reader(std::move(f));
-			pe.read_header();
+			if (m_index.find(id))
+				index_dirty = true;
+
+			continue;
+		}
+
+		egf.present = true;
+		egf.key.size = info.size;
+		egf.key.mtime = info.mtime;
+
+		if (!use_index)
+			continue;
 
-			auto&& bmp_table = pe.read_bitmap_table();
-			trace_log("EGF " << id << " table size " << bmp_table.size());
-			auto&& egf = EGF{id, std::move(pe), std::move(bmp_table)};
+		auto indexed = m_index.find(id);
 
-			m_egfs.push_back(std::move(egf));
+		if (indexed && indexed->key.size == egf.key.size && indexed->key.mtime == egf.key.mtime)
+		{
+			egf.key.hash = indexed->key.hash;
+			egf.index_table = indexed->table;
+			egf.from_index = true;
+		}
+		else
+		{
+			index_dirty = true;
 		}
 	}
+
+	if (index_dirty)
+		save_index();
+
+	if (use_index)
+		find_duplicates();
 }
 
-std::shared_ptr<Data::EGF_Graphic> Data::bitmap(int egf_id, int id)
+Data::EGF* Data::open_egf(int egf_id)
 {
-	if (egf_id > EGF_MAX)
+	if (egf_id < 1 || egf_id > int(m_egfs.size()))
 		return nullptr;
 
 	auto&& egf = m_egfs[egf_id - 1];
-	auto&& bmp_info_it = egf.bitmap_table.find(id);
 
-	if (bmp_info_it == egf.bitmap_table.end())
+	if (!egf.present)
+		return nullptr;
+
+	std::call_once(egf.open_once, [this, &egf]
 	{
-		trace_log("bmp " << egf_id << "/" << id << " not found");
+		read_egf(egf);
+		egf.opened = true;
+	});
+
+	if (!egf.file.is_open())
 		return nullptr;
+
+	return &egf;
+}
+
+void Data::read_egf(EGF& egf)
+{
+	if (!egf.file.open(egf_filename(egf.id).c_str()))
+	{
+		trace_log("EGF " << egf.id << " could not be opened");
+		return;
+	}
+
+	// Resources are read straight out of the mapping from here on
+	egf.pe = pe_reader(egf.file.view());
+
+	if (!egf.pe.read_header())
+	{
+		trace_log("EGF " << egf.id << " is not a PE file");
+		egf.file.close();
+		return;
+	}
+
+	auto hash = EGF_Index::header_hash(egf.file.view());
+
+	if (auto source = m_archive.source(egf.id))
+		egf.packed = (source->size == egf.key.size && source->hash == hash);
+
+	if (egf.from_index)
+	{
+		if (hash == egf.key.hash)
+			return;
+
+		trace_log("EGF " << egf.id << " has changed since it was indexed");
+		egf.index_table.reset();
+		egf.from_index = false;
+		m_index_stale = true;
+	}
+
+	egf.key.hash = hash;
+	egf.bitmap_table = egf.pe.read_bitmap_table();
+	trace_log("EGF " << egf.id << " table size " << egf.bitmap_table.size());
+}
+
+std::optional<GFX_Archive::Image> Data::packed_image(int egf_id, int id)
+{
+	if (!m_archive.is_open())
+		return std::nullopt;
+
+	auto egf = open_egf(egf_id);
+
+	if (!egf || !egf->packed)
+		return std::nullopt;
+
+	return m_archive.find(egf_id, id);
+}
+
+void Data::save_index()
+{
+	std::vector<EGF_Index::Entry> entries;
+
+	for (auto&& egf : m_egfs)
+	{
+		// Every file is checked, so nothing stale is carried over
+		if (!open_egf(egf.id))
+			continue;
+
+		auto&& table = egf.index_table ? egf.index_table->to_vector() : egf.bitmap_table;
+
+		for (auto&& info : table)
+		{
+			if (info.hash == 0)
+				info.hash = util::fnv1a_64(egf.pe.resource(info.start, info.size));
+		}
+
+		entries.push_back({egf.id, egf.key, table});
+	}
+
+	// The old index can't be replaced while it's mapped
+	// Tables of files which failed to open point in to it too, so every one is dropped
+	for (auto&& egf : m_egfs)
+		egf.index_table.reset();
+
+	for (auto&& entry : entries)
+		m_egfs[entry.id - 1].bitmap_table = entry.table;
+
+	m_index.close();
+	m_index_stale = false;
+
+	if (EGF_Index::write(g_config.GraphicsIndex, entries))
+		trace_log("wrote " << g_config.GraphicsIndex);
+}
+
+void Data::find_duplicates()
+{
+	struct First_Copy
+	{
+		std::uint64_t key;
+		std::size_t size;
+	};
+
+	std::unordered_map<std::uint64_t, First_Copy> first_copies;
+
+	m_aliases.clear();
+
+	auto add = [&](int egf_id, const pe_reader::BitmapInfo& info)
+	{
+		if (info.hash == 0)
+			return;
+
+		std::uint64_t key = graphic_key(egf_id, info.id);
+		auto result = first_copies.insert({info.hash, {key, info.size}});
+
+		if (!result.second && result.first->second.size == info.size)
+			m_aliases.insert({key, {result.first->second.key}});
+	};
+
+	for (auto&& egf : m_egfs)
+	{
+		if (egf.index_table)
+		{
+			for (std::size_t i = 0; i < egf.index_table->size(); ++i)
+				add(egf.id, (*egf.index_table)[i]);
+		}
+		else
+		{
+			for (auto&& info : egf.bitmap_table)
+				add(egf.id, info);
+		}
 	}
 
-	auto&& bmp_info = bmp_info_it->second;
+	trace_log(m_aliases.size() << " duplicate bitmaps of " << first_copies.size());
+}
+
+std::uint64_t Data::canonical_key(int egf_id, int id)
+{
+	std::uint64_t key = graphic_key(egf_id, id);
+	auto it = m_aliases.find(key);
+
+	if (it == m_aliases.end())
+		return key;
+
+	auto&& alias = it->second;
 
-	if (bmp_info.size < 2 || bmp_info.size > 0xFFFFFFFFU - 14)
+	// Checked against the tables actually in use, as either file could have changed since it was indexed
+	if (!alias.checked)
+	{
+		auto egf = open_egf(egf_id);
+		auto first_egf = open_egf(int(alias.key >> 32));
+
+		auto info = egf ? find_bitmap(*egf, id) : std::nullopt;
+		auto first = first_egf ? find_bitmap(*first_egf, int(alias.key & 0xFFFFFFFFU)) : std::nullopt;
+
+		if (!info || !first || info->hash == 0 || info->hash != first->hash || info->size != first->size)
+		{
+			m_aliases.erase(it);
+			return key;
+		}
+
+		// Matching hashes only make it likely the bitmaps are the same
+		auto dib = egf->pe.resource(info->start, info->size);
+
+		if (dib.empty() || dib != first_egf->pe.resource(first->start, first->size))
+		{
+			trace_log("bmp " << egf_id << "/" << id << " only shares a hash with its duplicate");
+			m_aliases.erase(it);
+			return key;
+		}
+
+		alias.checked = true;
+	}
+
+	return alias.key;
+}
+
+std::shared_ptr<Data::EGF_Graphic> Data::bitmap(int egf_id, int id)
+{
+	auto egf = open_egf(egf_id);
+
+	if (!egf)
+		return nullptr;
+
+	auto bmp_info = find_bitmap(*egf, id);
+
+	if (!bmp_info)
+	{
+		trace_log("bmp " << egf_id << "/" << id << " not found");
+		return nullptr;
+	}
+
+	if (bmp_info->size < 40)
 	{
 		trace_log("bmp size out of range");
 		return nullptr;
 	}
 
-	char dib_header_size_bytes[2];
+	auto dib = egf->pe.resource(bmp_info->start, bmp_info->size);
 
-	if (!egf.pe.read_resource(&dib_header_size_bytes[0], bmp_info.start, 2))
+	if (dib.empty())
 	{
-		trace_log("bmp header read failed");
+		trace_log("bmp read failed");
 		return nullptr;
 	}
 
-	auto&& dib_header_size = util::int_pack_16_le(dib_header_size_bytes);
+	return std::make_shared<EGF_Graphic>(EGF_Graphic{
+		*egf, dib, bmp_info->width, bmp_info->height
+	});
+}
+
+// Returns a reader ready to decode the bitmap, or nothing if it's in a format dib_reader can't decode
+static std::optional<dib_reader> start_dib(const Data::EGF_Graphic& bmp, std::optional<std::uint32_t> color_key)
+{
+	dib_reader reader(bmp.dib.data(), bmp.dib.size());
+	reader.start();
+
+	if (color_key)
+		reader.set_color_key(*color_key);
 
-	auto&& bmp_size_bytes = util::int_unpack_32_le(bmp_info.size + 14);
+	if (reader.check_format())
+		return std::nullopt;
+
+	int width = reader.width();
+	int height = std::abs(reader.height());
+
+	if (width == 0 || width > 0xFFFF || height == 0 || height > 0xFFFF)
+		return std::nullopt;
+
+	return reader;
+}
+
+bool Data::decode(std::uint64_t key, Graphic_Loader::Image& image)
+{
+	int egf_id = int(key >> 32);
+	int id = int(key & 0xFFFFFFFFU);
+
+	if (auto packed = packed_image(egf_id, id))
+	{
+		image.width = packed->width;
+		image.height = packed->height;
+		image.pixels.assign(packed->pixels.begin(), packed->pixels.end());
+		image.format = m_archive.format();
+		return true;
+	}
+
+	auto bmp = bitmap(egf_id, id);
+	auto reader = bmp ? start_dib(*bmp, m_color_key) : std::nullopt;
+
+	if (!reader)
+		return false;
+
+	int width = reader->width();
+	int height = std::abs(reader->height());
+	std::size_t line_size = std::size_t(width) * 4;
+
+	image.width = width;
+	image.height = height;
+	image.pixels.resize(line_size * height);
+	image.format = m_pixel_format.load(std::memory_order_relaxed);
+
+	reader->read_image(image.pixels.data(), std::ptrdiff_t(line_size), image.format);
+
+	return true;
+}
+
+Engine::Graphic Data::load_bmp(const EGF_Graphic& bmp)
+{
+	auto&& dib = bmp.dib;
+	auto dib_header_size = util::int_pack_32_le(dib.data());
+
+	auto&& bmp_size_bytes = util::int_unpack_32_le(dib.size() + 14);
 	auto&& pixel_offset_bytes = util::int_unpack_32_le(dib_header_size + 14);
 
-	std::vector<char> bmp_buf;
-	bmp_buf.resize(bmp_info.size + 14, '\0');
-	std::copy_n("BM", 2, &bmp_buf[0]);
-	std::copy_n(&bmp_size_bytes[0], 4, &bmp_buf[2]);
-	std::copy_n(&pixel_offset_bytes[0], 4, &bmp_buf[10]);
+	m_bmp_buffer.assign(dib.size() + 14, '\0');
+	std::copy_n("BM", 2, &m_bmp_buffer[0]);
+	std::copy_n(&bmp_size_bytes[0], 4, &m_bmp_buffer[2]);
+	std::copy_n(&pixel_offset_bytes[0], 4, &m_bmp_buffer[10]);
+	std::copy_n(dib.data(), dib.size(), &m_bmp_buffer[14]);
+
+	return g_engine->load_bmp(m_bmp_buffer.data(), m_bmp_buffer.size(), m_color_key);
+}
 
-	if (!egf.pe.read_resource(&bmp_buf[14], bmp_info.start, bmp_info.size))
+Engine::Graphic Data::graphic(int egf_id, int id)
+{
+	std::uint64_t key = canonical_key(egf_id, id);
+	EGF* requested = (egf_id >= 1 && egf_id <= int(m_egfs.size())) ? &m_egfs[egf_id - 1] : nullptr;
+
+	if (auto cached = m_graphic_cache.find(key))
 	{
-		trace_log("bmp read failed");
-		return nullptr;
+		if (requested)
+			++requested->hits;
+
+		return *cached;
+	}
+
+	if (requested)
+		++requested->misses;
+
+	egf_id = int(key >> 32);
+	id = int(key & 0xFFFFFFFFU);
+
+	Graphic_Loader::Image image;
+	Engine::Graphic graphic;
+
+	// A prefetch which is already under way is finished rather than started over
+	bool taken = m_loader && m_loader->take(key, image);
+
+	if (taken)
+	{
+		if (!image.pixels.empty())
+			graphic = g_engine->load_pixels(image.pixels.data(), image.width, image.height, image.format);
+	}
+	else if (auto packed = packed_image(egf_id, id))
+	{
+		// Uploaded straight out of the mapping
+		graphic = g_engine->load_pixels(packed->pixels.data(), packed->width, packed->height, m_archive.format());
+	}
+	else if (auto bmp = bitmap(egf_id, id))
+	{
+		// Decoded straight in to the new graphic
+		if (auto reader = start_dib(*bmp, m_color_key))
+		{
+			graphic = g_engine->create_graphic(reader->width(), std::abs(reader->height()),
+				[&reader](char* dest, std::ptrdiff_t pitch, Pixel_Format format)
+				{
+					reader->read_image(dest, pitch, format);
+				}
+			);
+		}
+	}
+
+	// Formats the decoder doesn't support go through the engine's loader
+	if (!graphic)
+	{
+		if (auto bmp = bitmap(egf_id, id))
+			graphic = load_bmp(*bmp);
+	}
+
+	if (!graphic)
+	{
+		trace_log("bmp " << egf_id << "/" << id << " failed to load");
+		return {};
+	}
+
+	m_graphic_cache.insert(key, graphic, Graphic_Cache::cost_of(graphic));
+
+	return graphic;
+}
+
+Engine::Graphic Data::graphic_frame(int egf_id, int id, int x, int y, int width, int height)
+{
+	if (x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > 0xFFFF || y + height > 0xFFFF)
+		return {};
+
+	std::uint64_t rect = std::uint64_t(x) | std::uint64_t(y) << 16
+	                   | std::uint64_t(width) << 32 | std::uint64_t(height) << 48;
+
+	auto frame_it = m_frame_ids.find(rect);
+
+	if (frame_it == m_frame_ids.end())
+	{
+		// Past the limit, new frames are still loaded but never cached
+		if (m_frame_ids.size() < max_frames)
+			frame_it = m_frame_ids.emplace(rect, std::uint32_t(m_frame_ids.size() + 1)).first;
 	}
 
-	auto&& graphic = EGF_Graphic{
-		egf, std::move(bmp_buf)
+	std::uint64_t key = canonical_key(egf_id, id);
+	std::uint64_t frame_key = 0;
+	EGF* requested = (egf_id >= 1 && egf_id <= int(m_egfs.size())) ? &m_egfs[egf_id - 1] : nullptr;
+
+	if (frame_it != m_frame_ids.end())
+	{
+		frame_key = key | std::uint64_t(frame_it->second) << frame_shift;
+
+		if (auto cached = m_graphic_cache.find(frame_key))
+		{
+			if (requested)
+				++requested->hits;
+
+			return *cached;
+		}
+	}
+
+	if (requested)
+		++requested->misses;
+
+	egf_id = int(key >> 32);
+	id = int(key & 0xFFFFFFFFU);
+
+	Engine::Graphic graphic;
+
+	if (auto packed = packed_image(egf_id, id))
+	{
+		// Uploaded straight out of the mapping, a row of the whole image apart
+		if (x + width <= packed->width && y + height <= packed->height)
+		{
+			const char* pixels = packed->pixels.data() + (std::size_t(y) * packed->width + x) * 4;
+
+			graphic = g_engine->load_pixels(pixels, width, height, m_archive.format(),
+				std::ptrdiff_t(packed->width) * 4);
+		}
+	}
+	else if (auto bmp = bitmap(egf_id, id))
+	{
+		// Only the frame is decoded, in to a graphic of its own
+		auto reader = start_dib(*bmp, m_color_key);
+
+		if (reader && x + width <= reader->width() && y + height <= std::abs(reader->height()))
+		{
+			graphic = g_engine->create_graphic(width, height,
+				[&](char* dest, std::ptrdiff_t pitch, Pixel_Format format)
+				{
+					reader->read_rect(dest, pitch, x, y, width, height, format);
+				}
+			);
+		}
+	}
+
+	if (!graphic)
+	{
+		trace_log("bmp " << egf_id << "/" << id << " frame " << x << "," << y << " "
+		          << width << "x" << height << " failed to load");
+		return {};
+	}
+
+	if (frame_key)
+		m_graphic_cache.insert(frame_key, graphic, Graphic_Cache::cost_of(graphic));
+
+	return graphic;
+}
+
+void Data::prefetch(int egf_id, int id)
+{
+	if (!m_loader)
+		return;
+
+	std::uint64_t key = canonical_key(egf_id, id);
+
+	if (m_graphic_cache.contains(key) || m_no_prefetch.count(key))
+		return;
+
+	// Images decoded to a stale format are still correct, load_pixels converts them
+	m_pixel_format.store(g_engine->native_format(), std::memory_order_relaxed);
+
+	m_loader->request(key);
+}
+
+void Data::prefetch_map(const Full_EMF& emf, int x, int y, int radius)
+{
+	if (!m_loader)
+		return;
+
+	m_loader->clear_requests();
+
+	auto prefetch_tile = [&](int tx, int ty)
+	{
+		if (tx < 0 || ty < 0 || tx >= emf.header.width || ty >= emf.header.height)
+			return;
+
+		auto&& gfx = emf.gfx(tx, ty);
+
+		for (int layer = 0; layer < int(gfx.size()); ++layer)
+		{
+			if (gfx[layer] > 0)
+				prefetch(map_layer_egf[layer], gfx[layer] + EGF_RESOURCE_BASE);
+		}
 	};
 
-	return std::make_shared<EGF_Graphic>(graphic);
+	if (emf.header.fill_tile > 0)
+		prefetch(map_layer_egf[0], emf.header.fill_tile + EGF_RESOURCE_BASE);
+
+	// Rings of tiles outwards from the centre
+	for (int r = 0; r <= radius; ++r)
+	{
+		for (int i = -r; i <= r; ++i)
+		{
+			prefetch_tile(x + i, y - r);
+
+			if (r > 0)
+				prefetch_tile(x + i, y + r);
+		}
+
+		for (int i = -r + 1; i <= r - 1; ++i)
+		{
+			prefetch_tile(x - r, y + i);
+			prefetch_tile(x + r, y + i);
+		}
+	}
+}
+
+void Data::prefetch_npc(int graphic)
+{
+	if (graphic <= 0)
+		return;
+
+	int base = (graphic - 1) * NPC_FRAMES + EGF_RESOURCE_BASE;
+
+	for (int frame = 1; frame <= NPC_FRAMES; ++frame)
+		prefetch(NPC_EGF, base + frame);
+}
+
+void Data::upload_prefetched()
+{
+	if (!m_loader)
+		return;
+
+	m_loader->collect(m_uploads, upload_budget);
+
+	for (auto&& image : m_uploads)
+	{
+		if (image.pixels.empty())
+		{
+			m_no_prefetch.insert(image.key);
+			continue;
+		}
+
+		if (m_graphic_cache.contains(image.key))
+			continue;
+
+		auto graphic = g_engine->load_pixels(image.pixels.data(), image.width, image.height, image.format);
+
+		if (graphic)
+			m_graphic_cache.insert(image.key, graphic, Graphic_Cache::cost_of(graphic));
+	}
+
+	m_uploads.clear();
+}
+
+Data::Memory_Stats Data::memory_stats(std::size_t largest)
+{
+	Memory_Stats stats;
+
+	stats.time = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	std::vector<std::size_t> egf_index(m_egfs.size() + 1, std::size_t(-1));
+
+	for (auto&& egf : m_egfs)
+	{
+		if (!egf.present)
+			continue;
+
+		EGF_Memory memory;
+		memory.id = egf.id;
+		memory.hits = egf.hits;
+		memory.misses = egf.misses;
+
+		// Files not opened yet, or being opened by a loader thread, are left at zero
+		if (egf.opened)
+		{
+			memory.mapped_bytes = egf.file.size();
+			memory.resident_bytes = egf.file.resident_size();
+			memory.table_bytes = egf.bitmap_table.capacity() * sizeof(pe_reader::BitmapInfo);
+		}
+
+		egf_index[egf.id] = stats.egfs.size();
+		stats.egfs.push_back(memory);
+	}
+
+	auto egf_memory = [&](std::uint64_t key) -> EGF_Memory*
+	{
+		auto egf_id = std::size_t((key >> 32) & 0xFF);
+
+		if (egf_id >= egf_index.size() || egf_index[egf_id] == std::size_t(-1))
+			return nullptr;
+
+		return &stats.egfs[egf_index[egf_id]];
+	};
+
+	m_graphic_cache.for_each([&](std::uint64_t key, const Engine::Graphic& graphic, std::size_t cost)
+	{
+		if (auto memory = egf_memory(key))
+		{
+			memory->gpu_bytes += cost;
+			++memory->graphics;
+		}
+
+		stats.largest.push_back({int((key >> 32) & 0xFF), int(key & 0xFFFFFFFFU), graphic.width(), graphic.height(), cost});
+	});
+
+	auto by_size = [](const Graphic_Memory& a, const Graphic_Memory& b) { return a.bytes > b.bytes; };
+
+	if (stats.largest.size() > largest)
+	{
+		std::partial_sort(stats.largest.begin(), stats.largest.begin() + largest, stats.largest.end(), by_size);
+		stats.largest.resize(largest);
+	}
+	else
+	{
+		std::sort(stats.largest.begin(), stats.largest.end(), by_size);
+	}
+
+	stats.cache = m_graphic_cache.stats();
+
+	if (m_loader)
+	{
+		stats.loader = m_loader->stats();
+
+		for (auto&& finished : m_loader->finished_sizes())
+		{
+			if (auto memory = egf_memory(finished.first))
+				memory->decoded_bytes += finished.second;
+		}
+	}
+
+	stats.index_bytes = m_index.mapped_size();
+	stats.archive_bytes = m_archive.mapped_size();
+	stats.archive_resident_bytes = m_archive.resident_size();
+	stats.duplicates = m_aliases.size();
+
+	return stats;
+}
+
+bool Data::write_memory_stats(const char* filename, std::size_t largest)
+{
+	cio::stream file(filename, cio::stream::mode_append);
+
+	if (!file)
+	{
+		trace_log("could not open " << filename);
+		return false;
+	}
+
+	auto line = memory_stats(largest).to_json();
+	line += '\n';
+
+	return file.write(line.data(), line.size()) == line.size();
+}
+
+std::string Data::Memory_Stats::to_json() const
+{
+	std::string out;
+
+	out += fmt::format(
+		"{{\"time\":{},\"index_bytes\":{},\"archive_bytes\":{},\"archive_resident_bytes\":{},\"duplicates\":{},",
+		time, index_bytes, archive_bytes, archive_resident_bytes, duplicates
+	);
+
+	out += fmt::format(
+		"\"cache\":{{\"hits\":{},\"misses\":{},\"evictions\":{},\"entries\":{},\"bytes\":{},\"budget\":{}}},",
+		cache.hits, cache.misses, cache.evictions, cache.entries, cache.bytes, cache.budget
+	);
+
+	out += fmt::format(
+		"\"loader\":{{\"requested\":{},\"decoded\":{},\"failed\":{},\"taken\":{},"
+		"\"queued\":{},\"finished\":{},\"finished_bytes\":{}}},",
+		loader.requested, loader.decoded, loader.failed, loader.taken,
+		loader.queued, loader.finished, loader.finished_bytes
+	);
+
+	out += "\"egfs\":[";
+
+	for (auto it = egfs.begin(); it != egfs.end(); ++it)
+	{
+		if (it != egfs.begin())
+			out += ',';
+
+		out += fmt::format(
+			"{{\"id\":{},\"mapped_bytes\":{},\"resident_bytes\":{},\"table_bytes\":{},\"decoded_bytes\":{},"
+			"\"gpu_bytes\":{},\"graphics\":{},\"hits\":{},\"misses\":{}}}",
+			it->id, it->mapped_bytes, it->resident_bytes, it->table_bytes, it->decoded_bytes,
+			it->gpu_bytes, it->graphics, it->hits, it->misses
+		);
+	}
+
+	out += "],\"largest\":[";
+
+	for (auto it = largest.begin(); it != largest.end(); ++it)
+	{
+		if (it != largest.begin())
+			out += ',';
+
+		out += fmt::format(
+			"{{\"egf\":{},\"id\":{},\"width\":{},\"height\":{},\"bytes\":{}}}",
+			it->egf_id, it->id, it->width, it->height, it->bytes
+		);
+	}
+
+	out += "]}";
+
+	return out;
 }
 
 // Global object
@@ -1,43 +1,270 @@
 #ifndef EO_DATA_HPP
 #define EO_DATA_HPP
 
+#include "data/egf_index.hpp"
+#include "data/gfx_archive.hpp"
 #include "data/pe_reader.hpp"
+#include "gfx/graphic_cache.hpp"
+#include "gfx/graphic_loader.hpp"
 
-#include <map>
+#include "engine.hpp"
+
+#include "cio/mapped_file.hpp"
+
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
-// TODO: caching, other data file types
+struct Full_EMF;
+
+// TODO: other data file types
 
 class Data
 {
 	public:
 		struct EGF
 		{
-			int id;
+			int id = 0;
+
+			// Set if the file existed at startup
+			bool present = false;
+			EGF_Index::File_Key key;
+
+			// Opened on first use, see open_egf
+			std::once_flag open_once;
+
+			// Set once open_once has run, after which the file can be inspected without opening it
+			std::atomic<bool> opened = false;
+			cio::mapped_file file;
 			pe_reader pe;
-			std::map<int, pe_reader::BitmapInfo> bitmap_table;
+
+			// Bitmaps are looked up in index_table, if set, otherwise in bitmap_table
+			pe_reader::Bitmap_Table bitmap_table;
+			std::optional<EGF_Index::Table> index_table;
+
+			// The table came from the index and is checked against the file when it's opened
+			bool from_index = false;
+
+			// Set once the file is open if the graphics archive was built from this version of it
+			bool packed = false;
+
+			// Cache lookups through graphic(), only touched by the main thread
+			std::uint64_t hits = 0;
+			std::uint64_t misses = 0;
 		};
 
 		struct EGF_Graphic
 		{
 			EGF& egf;
-			std::vector<char> bmp_data;
+
+			// The bitmap resource, a DIB without a BITMAPFILEHEADER
+			// Points in to egf.file, so is valid for as long as the data is loaded
+			std::string_view dib;
+
+			int width;
+			int height;
 		};
 
 		// first: egf id, second: graphic id
 		using EGF_Graphic_Ref = std::pair<int, int>;
 
+		struct EGF_Memory
+		{
+			int id = 0;
+
+			// Size of the file's view and how much of it is in physical memory, zero until it's opened
+			std::size_t mapped_bytes = 0;
+			std::size_t resident_bytes = 0;
+
+			// Bitmap table held in memory, zero while it's read from the index
+			std::size_t table_bytes = 0;
+
+			// Pixels decoded in the background, waiting to be uploaded
+			std::size_t decoded_bytes = 0;
+
+			// Graphics held by the cache, counted against the EGF of the copy that was loaded
+			std::size_t gpu_bytes = 0;
+			std::size_t graphics = 0;
+
+			std::uint64_t hits = 0;
+			std::uint64_t misses = 0;
+		};
+
+		struct Graphic_Memory
+		{
+			int egf_id = 0;
+			int id = 0;
+			int width = 0;
+			int height = 0;
+			std::size_t bytes = 0;
+		};
+
+		struct Memory_Stats
+		{
+			// Seconds since the epoch when the snapshot was taken
+			std::int64_t time = 0;
+
+			// Only EGFs which exist
+			std::vector<EGF_Memory> egfs;
+
+			// The biggest graphics held by the cache, largest first
+			std::vector<Graphic_Memory> largest;
+
+			Graphic_Cache::Stats cache;
+			Graphic_Loader::Stats loader;
+
+			std::size_t index_bytes = 0;
+			std::size_t archive_bytes = 0;
+			std::size_t archive_resident_bytes = 0;
+
+			// Bitmaps which share another's graphic, see find_duplicates
+			std::size_t duplicates = 0;
+
+			std::string to_json() const;
+		};
+
 	private:
-		// Data that is retained in memory
+		// Data that is retained in memory, indexed by id - 1
+		// Files which failed to load are left closed
 		std::vector<EGF> m_egfs;
 
+		// Bitmap tables saved by a previous run
+		EGF_Index m_index;
+
+		// An indexed file turned out to have changed, so the index is rewritten on exit
+		std::atomic<bool> m_index_stale = false;
+
+		// Graphics decoded ahead of time by egf_pack
+		GFX_Archive m_archive;
+
+		struct Alias
+		{
+			std::uint64_t key;
+
+			// Set once both bitmaps have been compared byte for byte
+			bool checked = false;
+		};
+
+		// Bitmaps with the same content as one earlier in the EGFs, keyed by egf_id << 32 | id
+		// Only the first copy is ever decoded or uploaded
+		std::unordered_map<std::uint64_t, Alias> m_aliases;
+
+		// Loaded graphics, keyed by egf_id << 32 | id, and frames of them also by frame number << 40
+		Graphic_Cache m_graphic_cache;
+
+		// Frame numbers, keyed by the rectangle packed as x | y << 16 | width << 32 | height << 48
+		// Main thread only
+		std::unordered_map<std::uint64_t, std::uint32_t> m_frame_ids;
+
+		// The engine's own pixel format, which graphics are decoded to
+		// Refreshed on the main thread as graphics are prefetched, as it's only known once the display exists
+		std::atomic<Pixel_Format> m_pixel_format = Pixel_Format::rgba;
+
+		// Color decoded as transparent, from GraphicsColorKey
+		std::optional<std::uint32_t> m_color_key;
+
+		// Decodes prefetched graphics, null if there are no loader threads
+		std::unique_ptr<Graphic_Loader> m_loader;
+
+		// Finished images waiting to be uploaded, reused between ticks
+		std::vector<Graphic_Loader::Image> m_uploads;
+
+		// Graphics the loader can't decode, left to the engine's own loader on demand
+		std::unordered_set<std::uint64_t> m_no_prefetch;
+
+		// Reused to give the engine a whole .bmp file
+		std::vector<char> m_bmp_buffer;
+
 		void load_all_data();
 
+		// Opens the file and reads its bitmap table, if that's not been done yet
+		// Returns null if the file is missing or invalid
+		EGF* open_egf(int egf_id);
+		void read_egf(EGF& egf);
+
+		// Null if the graphic isn't in the archive, or the archive is out of date for its EGF
+		std::optional<GFX_Archive::Image> packed_image(int egf_id, int id);
+
+		// Writes out the bitmap tables of every EGF, opening any not yet in use
+		// Resources which haven't been hashed yet are hashed, reading every EGF in full
+		void save_index();
+
+		// Fills m_aliases from the hashes in the bitmap tables
+		void find_duplicates();
+
+		// The key a graphic is loaded and cached under, which is its first copy's key if it has duplicates
+		// Main thread only
+		std::uint64_t canonical_key(int egf_id, int id);
+
+		// Decodes a graphic to the engine's format, or copies it from the archive in the archive's format
+		// Only reads the loaded EGF data, so is safe to call from the loader's threads
+		bool decode(std::uint64_t key, Graphic_Loader::Image& image);
+
+		Engine::Graphic load_bmp(const EGF_Graphic& bmp);
+
 	public:
+		Data();
+		~Data();
+
+		// no copy/move/assign
+		Data(const Data&) = delete;
+		const Data& operator=(const Data&) = delete;
+
+		// Safe to call from any thread once the data is loaded
 		std::shared_ptr<EGF_Graphic> bitmap(int egf_id, int id);
 
+		// Loads a graphic in to the engine, or returns the cached copy
+		// Returns an empty graphic if it doesn't exist
+		Engine::Graphic graphic(int egf_id, int id);
+
+		Engine::Graphic graphic(EGF_Graphic_Ref ref)
+		{
+			return graphic(ref.first, ref.second);
+		}
+
+		// Loads just the width x height part of a graphic at (x, y), such as one frame of a sprite sheet
+		// Only the frame is decoded and uploaded, and it's cached apart from the whole graphic
+		// Frames aren't prefetched, and formats only the engine's loader supports can't be split up
+		// Returns an empty graphic if it doesn't exist or the frame isn't inside it
+		Engine::Graphic graphic_frame(int egf_id, int id, int x, int y, int width, int height);
+
+		// Starts decoding a graphic in the background, unless it's already loaded
+		// Graphics requested first are decoded first
+		void prefetch(int egf_id, int id);
+
+		void prefetch(EGF_Graphic_Ref ref)
+		{
+			prefetch(ref.first, ref.second);
+		}
+
+		// Prefetches the map graphics within radius tiles of (x, y), nearest first
+		// Requests for anywhere further away which haven't been started are dropped
+		void prefetch_map(const Full_EMF& emf, int x, int y, int radius);
+
+		// Prefetches every frame of an NPC's sprite
+		void prefetch_npc(int graphic);
+
+		// Uploads graphics which have finished decoding in to the cache
+		// Call once per frame from the main thread
+		void upload_prefetched();
+
+		Graphic_Cache& graphic_cache() { return m_graphic_cache; }
+
+		// Where the data layer's memory is going, listing the largest cached graphics
+		// Main thread only
+		Memory_Stats memory_stats(std::size_t largest = 10);
+
+		// Appends memory_stats() to a file as one line of JSON
+		bool write_memory_stats(const char* filename, std::size_t largest = 10);
+
 	friend void eo_init_data();
 };
 
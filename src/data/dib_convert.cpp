@@ -0,0 +1,386 @@
+#include "dib_convert.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DIB_CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Lets a function use instructions the rest of the build isn't compiled for
+// MSVC allows any intrinsic without it
+#ifdef __GNUC__
+#define DIB_TARGET(isa) __attribute__((target(isa)))
+#else
+#define DIB_TARGET(isa)
+#endif
+
+// The same results as dib_reader's scale tables: round(v * 255 / 31) and round(v * 255 / 63)
+static inline unsigned expand5(unsigned v) { return (v * 527 + 23) >> 6; }
+static inline unsigned expand6(unsigned v) { return (v * 259 + 33) >> 6; }
+
+static inline void write_pixel(char* dest, unsigned r, unsigned g, unsigned b, bool bgra, std::uint32_t key)
+{
+	std::uint32_t pixel = bgra ? (b | g << 8 | r << 16) : (r | g << 8 | b << 16);
+	pixel |= 0xFF000000U;
+
+	if (pixel == key)
+		pixel = 0;
+
+	dest[0] = char(pixel);
+	dest[1] = char(pixel >> 8);
+	dest[2] = char(pixel >> 16);
+	dest[3] = char(pixel >> 24);
+}
+
+// Portable converters, also used for what's left of a row after the vector loops
+
+static void convert_bgrx32_scalar(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	for (int i = 0; i < width; ++i, src += 4, dest += 4)
+		write_pixel(dest, src[2], src[1], src[0], bgra, key);
+}
+
+static void convert_bgr24_scalar(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	for (int i = 0; i < width; ++i, src += 3, dest += 4)
+		write_pixel(dest, src[2], src[1], src[0], bgra, key);
+}
+
+template <bool is565>
+static void convert_rgb16_scalar(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	for (int i = 0; i < width; ++i, src += 2, dest += 4)
+	{
+		unsigned pixel = unsigned(src[0]) | (unsigned(src[1]) << 8);
+
+		unsigned r = expand5((pixel >> (is565 ? 11 : 10)) & 0x1F);
+		unsigned g = is565 ? expand6((pixel >> 5) & 0x3F) : expand5((pixel >> 5) & 0x1F);
+		unsigned b = expand5(pixel & 0x1F);
+
+		write_pixel(dest, r, g, b, bgra, key);
+	}
+}
+
+#ifdef DIB_CONVERT_X86
+
+// Loads stay within the row, the scalar converters finish off the last few pixels
+
+DIB_TARGET("sse2")
+static void convert_bgrx32_sse2(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	const __m128i alpha = _mm_set1_epi32(int(0xFF000000U));
+	const __m128i key_pixel = _mm_set1_epi32(int(key));
+	const __m128i low_byte = _mm_set1_epi32(0xFF);
+	const __m128i green = _mm_set1_epi32(0xFF00);
+
+	int i = 0;
+
+	for (; i + 4 <= width; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+
+		if (!bgra)
+		{
+			__m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), low_byte);
+			__m128i b = _mm_slli_epi32(_mm_and_si128(v, low_byte), 16);
+			v = _mm_or_si128(_mm_or_si128(r, b), _mm_and_si128(v, green));
+		}
+
+		v = _mm_or_si128(v, alpha);
+		v = _mm_andnot_si128(_mm_cmpeq_epi32(v, key_pixel), v);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 4), v);
+	}
+
+	convert_bgrx32_scalar(src + i * 4, dest + i * 4, width - i, bgra, key);
+}
+
+DIB_TARGET("avx2")
+static void convert_bgrx32_avx2(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	const __m256i alpha = _mm256_set1_epi32(int(0xFF000000U));
+	const __m256i key_pixel = _mm256_set1_epi32(int(key));
+	const __m256i low_byte = _mm256_set1_epi32(0xFF);
+	const __m256i green = _mm256_set1_epi32(0xFF00);
+
+	int i = 0;
+
+	for (; i + 8 <= width; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+
+		if (!bgra)
+		{
+			__m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 16), low_byte);
+			__m256i b = _mm256_slli_epi32(_mm256_and_si256(v, low_byte), 16);
+			v = _mm256_or_si256(_mm256_or_si256(r, b), _mm256_and_si256(v, green));
+		}
+
+		v = _mm256_or_si256(v, alpha);
+		v = _mm256_andnot_si256(_mm256_cmpeq_epi32(v, key_pixel), v);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i * 4), v);
+	}
+
+	convert_bgrx32_sse2(src + i * 4, dest + i * 4, width - i, bgra, key);
+}
+
+// Spreads 4 packed 3 byte pixels out to 4 bytes each, leaving alpha zero
+DIB_TARGET("ssse3")
+static __m128i bgr24_shuffle(bool bgra)
+{
+	return bgra
+		? _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1)
+		: _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+}
+
+DIB_TARGET("ssse3")
+static void convert_bgr24_ssse3(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	const __m128i shuffle = bgr24_shuffle(bgra);
+	const __m128i alpha = _mm_set1_epi32(int(0xFF000000U));
+	const __m128i key_pixel = _mm_set1_epi32(int(key));
+
+	std::size_t row_bytes = std::size_t(width) * 3;
+	int i = 0;
+
+	// Each load covers 4 pixels and 4 bytes of the next
+	for (; std::size_t(i) * 3 + 16 <= row_bytes; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+		v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha);
+		v = _mm_andnot_si128(_mm_cmpeq_epi32(v, key_pixel), v);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 4), v);
+	}
+
+	convert_bgr24_scalar(src + i * 3, dest + i * 4, width - i, bgra, key);
+}
+
+DIB_TARGET("avx2")
+static void convert_bgr24_avx2(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	// vpshufb works within each 128-bit lane, so each lane gets 4 pixels of its own
+	const __m256i shuffle = _mm256_broadcastsi128_si256(bgr24_shuffle(bgra));
+	const __m256i alpha = _mm256_set1_epi32(int(0xFF000000U));
+	const __m256i key_pixel = _mm256_set1_epi32(int(key));
+
+	std::size_t row_bytes = std::size_t(width) * 3;
+	int i = 0;
+
+	for (; std::size_t(i) * 3 + 28 <= row_bytes; i += 8)
+	{
+		__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+		__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+		v = _mm256_andnot_si256(_mm256_cmpeq_epi32(v, key_pixel), v);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i * 4), v);
+	}
+
+	convert_bgr24_ssse3(src + i * 3, dest + i * 4, width - i, bgra, key);
+}
+
+// Channels are widened to 16 bits and scaled with the same arithmetic as expand5 and expand6
+
+template <bool is565>
+DIB_TARGET("sse2")
+static void convert_rgb16_sse2(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	const __m128i mask_g = _mm_set1_epi16(is565 ? 0x3F : 0x1F);
+	const __m128i mul5 = _mm_set1_epi16(527);
+	const __m128i add5 = _mm_set1_epi16(23);
+	const __m128i mul_g = _mm_set1_epi16(is565 ? 259 : 527);
+	const __m128i add_g = _mm_set1_epi16(is565 ? 33 : 23);
+	const __m128i alpha = _mm_set1_epi16(short(0xFF00));
+	const __m128i key_pixel = _mm_set1_epi32(int(key));
+
+	int i = 0;
+
+	for (; i + 8 <= width; i += 8)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+
+		__m128i r = _mm_and_si128(_mm_srli_epi16(v, is565 ? 11 : 10), mask5);
+		__m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), mask_g);
+		__m128i b = _mm_and_si128(v, mask5);
+
+		r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(r, mul5), add5), 6);
+		g = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(g, mul_g), add_g), 6);
+		b = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(b, mul5), add5), 6);
+
+		// lo holds bytes 0 and 1 of each pixel, hi bytes 2 and 3
+		__m128i lo = _mm_or_si128(bgra ? b : r, _mm_slli_epi16(g, 8));
+		__m128i hi = _mm_or_si128(bgra ? r : b, alpha);
+
+		__m128i first = _mm_unpacklo_epi16(lo, hi);
+		__m128i second = _mm_unpackhi_epi16(lo, hi);
+
+		first = _mm_andnot_si128(_mm_cmpeq_epi32(first, key_pixel), first);
+		second = _mm_andnot_si128(_mm_cmpeq_epi32(second, key_pixel), second);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 4), first);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 4 + 16), second);
+	}
+
+	convert_rgb16_scalar<is565>(src + i * 2, dest + i * 4, width - i, bgra, key);
+}
+
+template <bool is565>
+DIB_TARGET("avx2")
+static void convert_rgb16_avx2(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key)
+{
+	const __m256i mask5 = _mm256_set1_epi16(0x1F);
+	const __m256i mask_g = _mm256_set1_epi16(is565 ? 0x3F : 0x1F);
+	const __m256i mul5 = _mm256_set1_epi16(527);
+	const __m256i add5 = _mm256_set1_epi16(23);
+	const __m256i mul_g = _mm256_set1_epi16(is565 ? 259 : 527);
+	const __m256i add_g = _mm256_set1_epi16(is565 ? 33 : 23);
+	const __m256i alpha = _mm256_set1_epi16(short(0xFF00));
+	const __m256i key_pixel = _mm256_set1_epi32(int(key));
+
+	int i = 0;
+
+	for (; i + 16 <= width; i += 16)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 2));
+
+		__m256i r = _mm256_and_si256(_mm256_srli_epi16(v, is565 ? 11 : 10), mask5);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi16(v, 5), mask_g);
+		__m256i b = _mm256_and_si256(v, mask5);
+
+		r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, mul5), add5), 6);
+		g = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(g, mul_g), add_g), 6);
+		b = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(b, mul5), add5), 6);
+
+		__m256i lo = _mm256_or_si256(bgra ? b : r, _mm256_slli_epi16(g, 8));
+		__m256i hi = _mm256_or_si256(bgra ? r : b, alpha);
+
+		// Unpacking works within lanes, giving pixels 0-3 and 8-11, then 4-7 and 12-15
+		__m256i first = _mm256_unpacklo_epi16(lo, hi);
+		__m256i second = _mm256_unpackhi_epi16(lo, hi);
+
+		first = _mm256_andnot_si256(_mm256_cmpeq_epi32(first, key_pixel), first);
+		second = _mm256_andnot_si256(_mm256_cmpeq_epi32(second, key_pixel), second);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i * 4), _mm256_permute2x128_si256(first, second, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i * 4 + 32), _mm256_permute2x128_si256(first, second, 0x31));
+	}
+
+	convert_rgb16_sse2<is565>(src + i * 2, dest + i * 4, width - i, bgra, key);
+}
+
+struct CPU_Features
+{
+	bool sse2 = false;
+	bool ssse3 = false;
+	bool avx2 = false;
+};
+
+static CPU_Features detect_cpu()
+{
+	CPU_Features cpu;
+
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	cpu.sse2 = __builtin_cpu_supports("sse2");
+	cpu.ssse3 = __builtin_cpu_supports("ssse3");
+	cpu.avx2 = __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	cpu.sse2 = (info[3] >> 26) & 1;
+	cpu.ssse3 = (info[2] >> 9) & 1;
+
+	// AVX registers also need saving by the OS
+	bool avx = ((info[2] >> 27) & 1) && ((info[2] >> 28) & 1) && (_xgetbv(0) & 6) == 6;
+
+	if (max_leaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		cpu.avx2 = avx && ((info[1] >> 5) & 1);
+	}
+#endif
+
+	return cpu;
+}
+
+#endif // DIB_CONVERT_X86
+
+struct Converters
+{
+	dib_convert_fn bgrx32 = convert_bgrx32_scalar;
+	dib_convert_fn bgr24 = convert_bgr24_scalar;
+	dib_convert_fn rgb555 = convert_rgb16_scalar<false>;
+	dib_convert_fn rgb565 = convert_rgb16_scalar<true>;
+
+	const char* isa = "scalar";
+};
+
+static Converters pick_converters()
+{
+	Converters converters;
+
+#ifdef DIB_CONVERT_X86
+	auto cpu = detect_cpu();
+
+	if (cpu.sse2)
+	{
+		converters.bgrx32 = convert_bgrx32_sse2;
+		converters.rgb555 = convert_rgb16_sse2<false>;
+		converters.rgb565 = convert_rgb16_sse2<true>;
+		converters.isa = "sse2";
+	}
+
+	if (cpu.sse2 && cpu.ssse3)
+	{
+		converters.bgr24 = convert_bgr24_ssse3;
+		converters.isa = "ssse3";
+	}
+
+	if (cpu.avx2)
+	{
+		converters.bgrx32 = convert_bgrx32_avx2;
+		converters.bgr24 = convert_bgr24_avx2;
+		converters.rgb555 = convert_rgb16_avx2<false>;
+		converters.rgb565 = convert_rgb16_avx2<true>;
+		converters.isa = "avx2";
+	}
+#endif
+
+	return converters;
+}
+
+// Picked once, the first time an image is decoded
+static const Converters& converters()
+{
+	static const Converters result = pick_converters();
+	return result;
+}
+
+dib_convert_fn dib_converter(DIB_Layout layout)
+{
+	switch (layout)
+	{
+		case DIB_Layout::bgrx32: return converters().bgrx32;
+		case DIB_Layout::bgr24:  return converters().bgr24;
+		case DIB_Layout::rgb555: return converters().rgb555;
+		case DIB_Layout::rgb565: return converters().rgb565;
+		case DIB_Layout::other:  break;
+	}
+
+	return nullptr;
+}
+
+const char* dib_converter_isa()
+{
+	return converters().isa;
+}
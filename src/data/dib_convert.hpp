@@ -0,0 +1,31 @@
+#ifndef EO_DIB_CONVERT_HPP
+#define EO_DIB_CONVERT_HPP
+
+// Converters from the common uncompressed DIB pixel layouts to 32-bit premultiplied pixels
+// The best one the CPU supports is picked at runtime, see dib_converter
+// Results match dib_reader's table based conversion exactly
+
+#include <cstdint>
+
+enum class DIB_Layout
+{
+	other,
+	bgrx32, // 32-bit, 0x00FF0000 / 0x0000FF00 / 0x000000FF masks
+	bgr24,  // 24-bit
+	rgb555, // 16-bit, 0x7C00 / 0x03E0 / 0x001F masks
+	rgb565  // 16-bit, 0xF800 / 0x07E0 / 0x001F masks
+};
+
+// Converts a row of width pixels, never reading past the end of them
+// Writes r, g, b, a bytes, or b, g, r, a if bgra is set, with alpha 0xFF
+// Pixels which come out equal to key, read as a little-endian word, are written as all zero
+// Zero never matches, so disables the key
+using dib_convert_fn = void (*)(const unsigned char* src, char* dest, int width, bool bgra, std::uint32_t key);
+
+// Null if there's no converter for the layout
+dib_convert_fn dib_converter(DIB_Layout layout);
+
+// Name of the instruction set the converters use, for logging
+const char* dib_converter_isa();
+
+#endif // EO_DIB_CONVERT_HPP
@@ -1,14 +1,13 @@
 
 #include "dib_reader.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <cstring>
 
 #define NUM_CONVERT_TABLES 8
 
-static bool convert_table_init = false;
-
 static int convert_table[(2 << (NUM_CONVERT_TABLES + 2)) - 2];
 
 static int* get_convert_table(int bit)
@@ -52,6 +51,52 @@ static void generate_scale_table(int* table, int entries)
 	}
 }
 
+static bool generate_convert_tables()
+{
+	for (int i = 0; i < NUM_CONVERT_TABLES; ++i)
+		generate_scale_table(get_convert_table(i), 1 << (i+1));
+
+	return true;
+}
+
+static inline void store_pixel(char* dest, std::uint32_t pixel)
+{
+	dest[0] = char(pixel);
+	dest[1] = char(pixel >> 8);
+	dest[2] = char(pixel >> 16);
+	dest[3] = char(pixel >> 24);
+}
+
+// An opaque 0xRRGGBB color as an output pixel read as a little-endian word
+static std::uint32_t format_pixel(std::uint32_t rgb, Pixel_Format format)
+{
+	std::uint32_t r = (rgb >> 16) & 0xFF;
+	std::uint32_t g = (rgb >> 8) & 0xFF;
+	std::uint32_t b = rgb & 0xFF;
+
+	if (format == Pixel_Format::bgra)
+		return b | g << 8 | r << 16 | 0xFF000000U;
+	else
+		return r | g << 8 | b << 16 | 0xFF000000U;
+}
+
+// Palette index of pixel i in a row of Bits bit indices, packed from the most significant bit
+template <int Bits> static inline unsigned pixel_index(const unsigned char* src, int i)
+{
+	constexpr int per_byte = 8 / Bits;
+
+	int shift = 8 - Bits - (i % per_byte) * Bits;
+
+	return (src[i / per_byte] >> shift) & ((1U << Bits) - 1);
+}
+
+template <int Bits> static void convert_indexed_row(const unsigned char* src, char* dest, int first, int width,
+                                                    const std::uint32_t* table)
+{
+	for (int i = 0; i < width; ++i)
+		store_pixel(dest + i * 4, table[pixel_index<Bits>(src, first + i)]);
+}
+
 const char* dib_reader::check_format() const
 {
 	if (width() < 0)
@@ -60,17 +105,55 @@ const char* dib_reader::check_format() const
 	if (width() > 0x40000000 || height() < -0x40000000 || height() > 0x40000000)
 		return "Image dimensions out of bounds";
 
-	if (depth() != 16 && depth() != 24 && depth() != 32)
-		return "Unsupported bit depth";
+	switch (depth())
+	{
+		case 1: case 4: case 8: case 16: case 24: case 32:
+			break;
+
+		default:
+			return "Unsupported bit depth";
+	}
+
+	switch (compression())
+	{
+		case RGB:
+			break;
+
+		case BitFields:
+			if (depth() <= 8)
+				return "Unsupported compression";
+
+			break;
 
-	if (compression() != RGB && compression() != BitFields)
-		return "Unsupported compression";
+		case RLE8:
+		case RLE4:
+			if (depth() != ((compression() == RLE8) ? 8 : 4))
+				return "Unsupported compression";
+
+			if (height() < 0)
+				return "RLE image stored top-down";
+
+			break;
+
+		default:
+			return "Unsupported compression";
+	}
+
+	// Palettized images don't use the color masks
+	if (depth() <= 8)
+		return nullptr;
 
 	constexpr int maxmask = (1 << NUM_CONVERT_TABLES) - 1;
 
 	if (rm > maxmask || gm > maxmask || bm > maxmask || am > maxmask)
 		return "Bit mask too long";
 
+	if (compression() == BitFields && (rm == 0 || gm == 0 || bm == 0))
+		return "Missing color mask";
+
+	if (!rtable || !gtable || !btable)
+		return "Unsupported color mask";
+
 	if (depth() == 16)
 	{
 		if (compression() == BitFields)
@@ -87,6 +170,10 @@ const char* dib_reader::check_format() const
 
 void dib_reader::start()
 {
+	// Graphics may be decoded on several threads at once
+	static const bool convert_table_init = generate_convert_tables();
+	(void)convert_table_init;
+
 	if (compression() == BitFields)
 	{
 		decode_bitfield(red_mask(),   rs, rm);
@@ -120,10 +207,6 @@ void dib_reader::start()
 		std::uint32_t mask = ~(0xFFFFFFFFU << (i+1)) & 0xFFFFFFFFU;
 
 		int* table = get_convert_table(i);
-		int entries = (1 << (i+1));
-
-		if (!convert_table_init)
-			generate_scale_table(table, entries);
 
 		if (rm == mask) rtable = table;
 		if (gm == mask) gtable = table;
@@ -131,36 +214,307 @@ void dib_reader::start()
 		if (am == mask) atable = table;
 	}
 
-	convert_table_init = true;
+	// Alpha masks are ignored like everywhere else, so don't affect the layout
+	DIB_Layout layout = DIB_Layout::other;
+
+	if (depth() == 32 && rs == 16 && rm == 0xFF && gs == 8 && gm == 0xFF && bs == 0 && bm == 0xFF)
+		layout = DIB_Layout::bgrx32;
+	else if (depth() == 24 && rs == 16 && rm == 0xFF && gs == 8 && gm == 0xFF && bs == 0 && bm == 0xFF)
+		layout = DIB_Layout::bgr24;
+	else if (depth() == 16 && rs == 10 && rm == 0x1F && gs == 5 && gm == 0x1F && bs == 0 && bm == 0x1F)
+		layout = DIB_Layout::rgb555;
+	else if (depth() == 16 && rs == 11 && rm == 0x1F && gs == 5 && gm == 0x3F && bs == 0 && bm == 0x1F)
+		layout = DIB_Layout::rgb565;
+
+	convert = dib_converter(layout);
+
+	if (compression() == RGB)
+	{
+		switch (depth())
+		{
+			case 1: convert_indexed = convert_indexed_row<1>; break;
+			case 4: convert_indexed = convert_indexed_row<4>; break;
+			case 8: convert_indexed = convert_indexed_row<8>; break;
+		}
+	}
 }
 
-void dib_reader::read_line(char* outbuf, int row)
+std::uint64_t dib_reader::row_offset(int row) const noexcept
 {
 	int line = ((height() < 0) ? row : height() - 1 - row);
 
-	const char *linebuf = data() + stride() * line;
+	return std::uint64_t(std::uint32_t(header_size())) + palette_size()
+	     + stride() * std::uint32_t(line);
+}
 
-	for (int i = 0; i < width(); i++)
+std::uint32_t dib_reader::key_pixel(Pixel_Format format) const noexcept
+{
+	return use_key ? format_pixel(key_rgb, format) : 0;
+}
+
+void dib_reader::build_palette(Pixel_Format format)
+{
+	if (palette_ready && palette_format == format)
+		return;
+
+	std::uint32_t colors = std::min(palette_colors(), 256U);
+	std::size_t start = std::uint32_t(header_size());
+	std::uint32_t key = key_pixel(format);
+
+	for (std::uint32_t i = 0; i < 256; ++i)
 	{
-		std::size_t pixel_offset = linebuf - data_ptr;
-		std::uint32_t pixel;
+		// Entries are b, g, r, reserved, and indices past the end of the palette are black
+		std::uint32_t rgb = (i < colors) ? (read_u32_le_checked(start + i * 4) & 0xFFFFFFU) : 0;
+		std::uint32_t pixel = format_pixel(rgb, format);
 
-		if (pixel_offset < data_size)
-			pixel = read_u32_le(pixel_offset);
-		else
+		if (pixel == key)
 			pixel = 0;
+		else if (recolor)
+			pixel = format_pixel(recolor(rgb), format);
+
+		palette_table[i] = pixel;
+	}
 
-		std::uint8_t r = static_cast<std::uint8_t>(rtable[((pixel >> rs) & rm)]);
-		std::uint8_t g = static_cast<std::uint8_t>(gtable[((pixel >> gs) & gm)]);
-		std::uint8_t b = static_cast<std::uint8_t>(btable[((pixel >> bs) & bm)]);
-		std::uint8_t a = 0xFF;
+	palette_format = format;
+	palette_ready = true;
+}
+
+void dib_reader::convert_pixels(std::uint64_t offset, int first, char* outbuf, int count, Pixel_Format format) const
+{
+	if (depth() <= 8)
+	{
+		unsigned bits = std::uint16_t(depth());
+
+		for (int i = 0; i < count; i++)
+		{
+			std::uint64_t bit = std::uint64_t(first + i) * bits;
+			std::uint64_t byte_offset = offset + bit / 8;
+			unsigned byte = (byte_offset < data_size) ? std::uint8_t(data_ptr[byte_offset]) : 0;
+			unsigned index = (byte >> (8 - bits - bit % 8)) & ((1U << bits) - 1);
+
+			store_pixel(outbuf + i * 4, palette_table[index]);
+		}
 
-		outbuf[0] = r;
-		outbuf[1] = g;
-		outbuf[2] = b;
-		outbuf[3] = a;
+		return;
+	}
 
-		linebuf += bpp();
+	bool bgra = (format == Pixel_Format::bgra);
+	std::uint32_t key = key_pixel(format);
+
+	offset += std::uint64_t(first) * std::uint32_t(bpp());
+
+	for (int i = 0; i < count; i++)
+	{
+		std::uint32_t pixel = (offset < data_size) ? read_u32_le_checked(std::size_t(offset)) : 0;
+
+		std::uint32_t r = std::uint8_t(rtable[((pixel >> rs) & rm)]);
+		std::uint32_t g = std::uint8_t(gtable[((pixel >> gs) & gm)]);
+		std::uint32_t b = std::uint8_t(btable[((pixel >> bs) & bm)]);
+
+		std::uint32_t out = bgra ? (b | g << 8 | r << 16) : (r | g << 8 | b << 16);
+		out |= 0xFF000000U;
+
+		if (out == key)
+			out = 0;
+
+		store_pixel(outbuf, out);
+
+		offset += bpp();
 		outbuf += 4;
 	}
 }
+
+void dib_reader::decode_rle(char* dest, std::ptrdiff_t pitch, int first_row, int row_count, int first_col, int col_count) const
+{
+	int width = this->width();
+	int rows = height();
+	bool rle4 = (compression() == RLE4);
+
+	std::uint64_t pos = std::uint64_t(std::uint32_t(header_size())) + palette_size();
+	std::uint64_t end = data_size;
+
+	// Lines count up from the bottom row, so the rows wanted end at this line
+	int last_line = rows - first_row;
+
+	int line = 0;
+	int x = 0;
+
+	auto byte_at = [this](std::uint64_t offset) { return unsigned(std::uint8_t(data_ptr[offset])); };
+
+	// Null while the current line isn't one of the rows wanted
+	auto row_at = [&](int line) -> char*
+	{
+		int row = rows - 1 - line;
+
+		if (row < first_row || row >= first_row + row_count)
+			return nullptr;
+
+		return dest + pitch * (row - first_row);
+	};
+
+	char* row_ptr = row_at(0);
+
+	int last_col = first_col + col_count;
+
+	// Pixels past the end of the line are dropped, so x never goes past width
+	auto fill = [&](int to, std::uint32_t pixel)
+	{
+		to = std::min(to, width);
+
+		if (row_ptr)
+			for (int i = std::max(x, first_col); i < std::min(to, last_col); ++i)
+				store_pixel(row_ptr + (i - first_col) * 4, pixel);
+
+		x = std::max(x, to);
+	};
+
+	auto put = [&](std::uint32_t pixel)
+	{
+		if (x < width)
+		{
+			if (row_ptr && x >= first_col && x < last_col)
+				store_pixel(row_ptr + (x - first_col) * 4, pixel);
+
+			++x;
+		}
+	};
+
+	// Pixels jumped over by end of line and delta codes are left as palette entry 0
+	auto skip_to = [&](int to_x, int to_line)
+	{
+		while (line < to_line && line < last_line)
+		{
+			fill(width, palette_table[0]);
+			++line;
+			x = 0;
+			row_ptr = row_at(line);
+		}
+
+		if (line == to_line)
+			fill(to_x, palette_table[0]);
+	};
+
+	while (line < last_line && pos < end && end - pos >= 2)
+	{
+		unsigned count = byte_at(pos);
+		unsigned value = byte_at(pos + 1);
+		pos += 2;
+
+		if (count > 0)
+		{
+			// RLE4 runs alternate between the two indices in the byte
+			if (rle4 && (value >> 4) != (value & 0x0F))
+			{
+				std::uint32_t pixels[2] = {palette_table[value >> 4], palette_table[value & 0x0F]};
+
+				for (unsigned i = 0; i < count; ++i)
+					put(pixels[i & 1]);
+			}
+			else
+			{
+				fill(x + int(count), palette_table[rle4 ? (value & 0x0F) : value]);
+			}
+		}
+		else if (value == 0)
+		{
+			skip_to(0, line + 1);
+		}
+		else if (value == 1)
+		{
+			break;
+		}
+		else if (value == 2)
+		{
+			if (end - pos < 2)
+				break;
+
+			int dx = int(byte_at(pos));
+			int dy = int(byte_at(pos + 1));
+			pos += 2;
+
+			skip_to(x + dx, line + dy);
+		}
+		else
+		{
+			// Absolute mode, padded to a 16-bit boundary
+			std::uint64_t bytes = rle4 ? (value + 1) / 2 : value;
+
+			for (unsigned i = 0; i < value && pos + (rle4 ? i / 2 : i) < end; ++i)
+			{
+				unsigned index = byte_at(pos + (rle4 ? i / 2 : i));
+
+				if (rle4)
+					index = (i & 1) ? (index & 0x0F) : (index >> 4);
+
+				put(palette_table[index]);
+			}
+
+			pos += (bytes + 1) & ~std::uint64_t(1);
+		}
+	}
+
+	// Rows the data stopped short of are left as palette entry 0
+	skip_to(width, last_line);
+}
+
+void dib_reader::read_line(char* outbuf, int row, Pixel_Format format)
+{
+	if (depth() <= 8)
+		build_palette(format);
+
+	if (compression() == RLE8 || compression() == RLE4)
+		decode_rle(outbuf, 0, row, 1, 0, width());
+	else
+		convert_pixels(row_offset(row), 0, outbuf, width(), format);
+}
+
+void dib_reader::read_image(char* dest, std::ptrdiff_t pitch, Pixel_Format format)
+{
+	int rows = (height() < 0) ? -height() : height();
+
+	read_rect(dest, pitch, 0, 0, width(), rows, format);
+}
+
+bool dib_reader::read_rect(char* dest, std::ptrdiff_t pitch, int x, int y, int width, int height, Pixel_Format format)
+{
+	std::int64_t rows = (this->height() < 0) ? -std::int64_t(this->height()) : this->height();
+
+	if (x < 0 || y < 0 || width < 0 || height < 0
+	 || std::int64_t(x) + width > this->width() || std::int64_t(y) + height > rows)
+		return false;
+
+	if (depth() <= 8)
+		build_palette(format);
+
+	if (compression() == RLE8 || compression() == RLE4)
+	{
+		decode_rle(dest, pitch, y, height, x, width);
+		return true;
+	}
+
+	// Bytes of each row the rectangle covers, the first of which may be shared with pixels to its left
+	unsigned bits = std::uint16_t(depth());
+	std::uint64_t first_byte = std::uint64_t(x) * bits / 8;
+	std::uint64_t end_byte = ((std::uint64_t(x) + std::uint32_t(width)) * bits + 7) / 8;
+
+	bool bgra = (format == Pixel_Format::bgra);
+	std::uint32_t key = key_pixel(format);
+
+	for (int row = 0; row < height; ++row)
+	{
+		std::uint64_t offset = row_offset(y + row);
+		char* outbuf = dest + pitch * row;
+
+		// Rows cut short by the end of the data are left to the checked path
+		bool whole = (offset <= data_size && end_byte <= data_size - offset);
+
+		if (whole && convert)
+			convert(reinterpret_cast<const unsigned char*>(data_ptr + offset + first_byte), outbuf, width, bgra, key);
+		else if (whole && convert_indexed)
+			convert_indexed(reinterpret_cast<const unsigned char*>(data_ptr + offset), outbuf, x, width, palette_table);
+		else
+			convert_pixels(offset, x, outbuf, width, format);
+	}
+
+	return true;
+}
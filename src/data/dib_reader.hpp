@@ -2,7 +2,11 @@
 #define EO_DIB_READER_HPP
 
 #include "cio/cio.hpp"
+#include "data/dib_convert.hpp"
+#include "gfx/pixel_format.hpp"
+#include "util/function.hpp"
 
+#include <cstddef>
 #include <cstdint>
 #include <utility>
 
@@ -14,14 +18,31 @@ class dib_reader
 		const char* data_ptr;
 		std::size_t data_size;
 
-		int           rs, gs, bs, as;
-		std::uint32_t rm, gm, bm, am;
+		int           rs = 0, gs = 0, bs = 0, as = 0;
+		std::uint32_t rm = 0, gm = 0, bm = 0, am = 0;
 
 		int* rtable = nullptr;
 		int* gtable = nullptr;
 		int* btable = nullptr;
 		int* atable = nullptr;
 
+		// Set by start() if the layout has a fast converter
+		dib_convert_fn convert = nullptr;
+
+		// Set by start() for uncompressed palettized images
+		// Converts the width pixels from index first on in the row at src
+		void (*convert_indexed)(const unsigned char* src, char* dest, int first, int width, const std::uint32_t* table) = nullptr;
+
+		bool use_key = false;
+		std::uint32_t key_rgb = 0;
+
+		util::function<std::uint32_t(std::uint32_t rgb)> recolor;
+
+		// Every palette index as an output pixel, built for one format at a time
+		std::uint32_t palette_table[256] = {};
+		Pixel_Format palette_format = Pixel_Format::rgba;
+		bool palette_ready = false;
+
 		std::uint16_t read_u16_le(std::size_t offset) const noexcept
 		{
 			char a = data_ptr[offset];
@@ -40,6 +61,37 @@ class dib_reader
 			return util::int_pack_32_le(a, b, c, d);
 		}
 
+		// Bytes past the end of the data read as zero
+		std::uint32_t read_u32_le_checked(std::size_t offset) const noexcept
+		{
+			if (offset < data_size && data_size - offset >= 4)
+				return read_u32_le(offset);
+
+			std::uint32_t pixel = 0;
+
+			for (std::size_t i = 0; i < 4 && offset + i < data_size; ++i)
+				pixel |= std::uint32_t(std::uint8_t(data_ptr[offset + i])) << (i * 8);
+
+			return pixel;
+		}
+
+		// Offset of the start of a row of pixels, rows are stored bottom-up unless height() is negative
+		std::uint64_t row_offset(int row) const noexcept;
+
+		// The color key as a decoded pixel read as a little-endian word, zero if there isn't one
+		std::uint32_t key_pixel(Pixel_Format format) const noexcept;
+
+		void build_palette(Pixel_Format format);
+
+		// Converts count pixels from index first on in the row at offset, one at a time through the
+		// scale tables or the palette table
+		void convert_pixels(std::uint64_t offset, int first, char* outbuf, int count, Pixel_Format format) const;
+
+		// Decodes the rows from first_row to first_row + row_count, counting from the top, in to dest
+		// Only the columns from first_col to first_col + col_count are written, starting at the left of dest
+		// RLE images can only be read from the start, so this stops once it's past the last of the rows
+		void decode_rle(char* dest, std::ptrdiff_t pitch, int first_row, int row_count, int first_col, int col_count) const;
+
 	public:
 		enum Compression
 		{
@@ -67,13 +119,20 @@ class dib_reader
 		std::uint32_t image_size()   const noexcept { return read_u32_le(20); }
 		std::int32_t  hres()         const noexcept { return read_u32_le(24); }
 		std::int32_t  vres()         const noexcept { return read_u32_le(28); }
-		std::size_t   palette_size() const noexcept
+		std::uint32_t colors_used()  const noexcept { return read_u32_le(32); }
+
+		// Number of palette entries, which defaults to every index for images of 8 bits or less
+		std::uint32_t palette_colors() const noexcept
 		{
-			std::size_t size = 0;
-			std::uint32_t colors_used = read_u32_le(32);
+			if (colors_used() == 0 && depth() <= 8)
+				return 1U << depth();
+
+			return colors_used();
+		}
 
-			if (colors_used)
-				size += colors_used * (1U << (bpp() - 1)) * bpp();
+		std::size_t   palette_size() const noexcept
+		{
+			std::size_t size = std::size_t(palette_colors()) * 4;
 
 			if (header_size() < 52 && compression() == Compression::BitFields)
 				size += 12;
@@ -86,34 +145,70 @@ class dib_reader
 		const char*   raw_data()     const noexcept { return reinterpret_cast<const char*>(data_ptr); }
 
 		std::int16_t  bpp()          const noexcept { return static_cast<std::int16_t>(depth() >> 3); }
-		std::int32_t  stride()       const noexcept { return width() * bpp() + ((4U - (width() * bpp())) & 3); }
+		std::uint64_t stride()       const noexcept { return (std::uint64_t(std::uint32_t(width())) * std::uint16_t(depth()) + 31) / 32 * 4; }
 
 		std::uint32_t red_mask()     const noexcept {
-			return read_u32_le(40);
+			return read_u32_le_checked(40);
 		}
 
 		std::uint32_t green_mask()   const noexcept {
-			return read_u32_le(44);
+			return read_u32_le_checked(44);
 		}
 
 		std::uint32_t blue_mask()    const noexcept {
-			return read_u32_le(48);
+			return read_u32_le_checked(48);
 		}
 
 		std::uint32_t alpha_mask()   const noexcept {
 			return header_size() >= 56
-				? read_u32_le(52)
+				? read_u32_le_checked(52)
 				: 0;
 		}
 
 		// Returns a pointer to a human readable string describing what's wrong with the file
 		// Returns nullptr if the format is acceptable
+		// Call after start(), which reads the color masks
 		const char* check_format() const;
 
 		void start();
 
-		// outbuf must be at least line_size() bytes
-		void read_line(char* outbuf, int row);
+		// Pixels of the 0xRRGGBB color decode as all zero, which is transparent in premultiplied alpha
+		// Every other pixel is opaque, so the output is premultiplied either way
+		void set_color_key(std::uint32_t rgb) noexcept
+		{
+			use_key = true;
+			key_rgb = rgb & 0xFFFFFFU;
+			palette_ready = false;
+		}
+
+		void clear_color_key() noexcept
+		{
+			use_key = false;
+			palette_ready = false;
+		}
+
+		// Maps each 0xRRGGBB palette color to another, for recoloring palettized images such as hair dyes
+		// Applied once per palette entry, after the color key, and ignored for images without a palette
+		void set_recolor(util::function<std::uint32_t(std::uint32_t rgb)> f)
+		{
+			recolor = std::move(f);
+			palette_ready = false;
+		}
+
+		// Writes 4 bytes per pixel in the given order, outbuf must be at least width() * 4 bytes
+		void read_line(char* outbuf, int row, Pixel_Format format = Pixel_Format::rgba);
+
+		// Decodes the whole image top row first, each row pitch bytes after the last
+		// Common layouts use the converters in dib_convert.hpp, palettized and RLE images the palette table,
+		// and the rest go through the scale tables one pixel at a time
+		void read_image(char* dest, std::ptrdiff_t pitch, Pixel_Format format = Pixel_Format::rgba);
+
+		// Decodes just the width x height pixels at (x, y), counting from the top left, like read_image
+		// Only the source rows and columns inside the rectangle are read, except that RLE images are
+		// read from the start up to its last row
+		// Returns false without writing anything if the rectangle isn't inside the image
+		bool read_rect(char* dest, std::ptrdiff_t pitch, int x, int y, int width, int height,
+		               Pixel_Format format = Pixel_Format::rgba);
 };
 
 #endif // EO_DIB_READER_HPP
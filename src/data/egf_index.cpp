@@ -0,0 +1,226 @@
+#include "egf_index.hpp"
+
+#include "util/hash.hpp"
+#include "util/int_pack.hpp"
+
+#include "cio/cio.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#define TRACE_CTX "egf_index"
+
+static void append_u32_le(std::vector<char>& buf, std::uint32_t n)
+{
+	for (int i = 0; i < 4; ++i)
+		buf.push_back(char((n >> (i * 8)) & 0xFF));
+}
+
+static void append_u64_le(std::vector<char>& buf, std::uint64_t n)
+{
+	for (int i = 0; i < 8; ++i)
+		buf.push_back(char((n >> (i * 8)) & 0xFF));
+}
+
+pe_reader::BitmapInfo EGF_Index::Table::operator[](std::size_t i) const
+{
+	const char* p = m_records.data() + i * record_size;
+
+	return {
+		int(util::int_pack_32_le(p)),
+		util::int_pack_32_le(p + 4),
+		util::int_pack_32_le(p + 8),
+		int(util::int_pack_32_le(p + 12)),
+		int(util::int_pack_32_le(p + 16)),
+		util::int_pack_64_le(p + 20)
+	};
+}
+
+std::optional<pe_reader::BitmapInfo> EGF_Index::Table::find(int id) const
+{
+	std::size_t lo = 0;
+	std::size_t hi = size();
+
+	while (lo < hi)
+	{
+		std::size_t mid = lo + (hi - lo) / 2;
+		int mid_id = int(util::int_pack_32_le(m_records.data() + mid * record_size));
+
+		if (mid_id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == size())
+		return std::nullopt;
+
+	auto info = (*this)[lo];
+
+	if (info.id != id)
+		return std::nullopt;
+
+	return info;
+}
+
+pe_reader::Bitmap_Table EGF_Index::Table::to_vector() const
+{
+	pe_reader::Bitmap_Table table;
+	table.reserve(size());
+
+	for (std::size_t i = 0; i < size(); ++i)
+		table.push_back((*this)[i]);
+
+	return table;
+}
+
+bool EGF_Index::open(const char* filename)
+{
+	close();
+
+	if (!m_file.open(filename))
+		return false;
+
+	auto data = m_file.view();
+
+	if (data.size() < header_size
+	 || data.substr(0, sizeof magic) != std::string_view(magic, sizeof magic)
+	 || util::int_pack_32_le(&data[4]) != version)
+	{
+		trace_log(filename << " is not a valid index");
+		close();
+		return false;
+	}
+
+	std::size_t count = util::int_pack_32_le(&data[8]);
+	std::size_t records_start = header_size + count * file_size;
+
+	if (count > (data.size() - header_size) / file_size)
+	{
+		trace_log(filename << " is truncated");
+		close();
+		return false;
+	}
+
+	std::size_t total_records = (data.size() - records_start) / record_size;
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const char* p = data.data() + header_size + i * file_size;
+
+		std::size_t first = util::int_pack_32_le(p + 4);
+		std::size_t n = util::int_pack_32_le(p + 8);
+
+		if (first > total_records || n > total_records - first)
+		{
+			trace_log(filename << " is truncated");
+			close();
+			return false;
+		}
+
+		File file;
+		file.id = int(util::int_pack_32_le(p));
+		file.key.size = util::int_pack_64_le(p + 12);
+		file.key.mtime = std::int64_t(util::int_pack_64_le(p + 20));
+		file.key.hash = util::int_pack_64_le(p + 28);
+		file.table = Table(data.substr(records_start + first * record_size, n * record_size));
+
+		m_files.push_back(file);
+	}
+
+	return true;
+}
+
+void EGF_Index::close()
+{
+	m_files.clear();
+	m_file.close();
+}
+
+const EGF_Index::File* EGF_Index::find(int egf_id) const
+{
+	auto it = std::find_if(m_files.begin(), m_files.end(),
+		[egf_id](const File& file) { return file.id == egf_id; });
+
+	if (it == m_files.end())
+		return nullptr;
+
+	return &*it;
+}
+
+bool EGF_Index::write(const char* filename, const std::vector<Entry>& entries)
+{
+	std::vector<char> buf(std::begin(magic), std::end(magic));
+	append_u32_le(buf, version);
+	append_u32_le(buf, std::uint32_t(entries.size()));
+
+	std::uint32_t first = 0;
+
+	for (auto&& entry : entries)
+	{
+		append_u32_le(buf, std::uint32_t(entry.id));
+		append_u32_le(buf, first);
+		append_u32_le(buf, std::uint32_t(entry.table.size()));
+		append_u64_le(buf, entry.key.size);
+		append_u64_le(buf, std::uint64_t(entry.key.mtime));
+		append_u64_le(buf, entry.key.hash);
+
+		first += std::uint32_t(entry.table.size());
+	}
+
+	for (auto&& entry : entries)
+	{
+		for (auto&& info : entry.table)
+		{
+			append_u32_le(buf, std::uint32_t(info.id));
+			append_u32_le(buf, std::uint32_t(info.start));
+			append_u32_le(buf, std::uint32_t(info.size));
+			append_u32_le(buf, std::uint32_t(info.width));
+			append_u32_le(buf, std::uint32_t(info.height));
+			append_u64_le(buf, info.hash);
+		}
+	}
+
+	// Written aside and moved in to place, so a partly written index is never read
+	std::string part_filename = std::string(filename) + ".part";
+
+	{
+		cio::stream file(part_filename.c_str(), cio::stream::mode_write);
+
+		if (!file || file.write(buf.data(), buf.size()) != buf.size())
+		{
+			trace_log("could not write " << part_filename);
+			file.close();
+			std::remove(part_filename.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	// rename() won't replace an existing file here, elsewhere it replaces it atomically
+	std::remove(filename);
+#endif // _WIN32
+
+	if (std::rename(part_filename.c_str(), filename) != 0)
+	{
+		trace_log("could not move " << part_filename << " in to place");
+		std::remove(part_filename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+std::uint64_t EGF_Index::header_hash(std::string_view data)
+{
+	constexpr std::size_t sample_size = 64 * 1024;
+
+	if (data.size() <= sample_size * 2)
+		return util::fnv1a_64(data);
+
+	auto hash = util::fnv1a_64(data.substr(0, sample_size));
+	return util::fnv1a_64(data.substr(data.size() - sample_size), hash);
+}
@@ -0,0 +1,106 @@
+#ifndef EO_DATA_EGF_INDEX_HPP
+#define EO_DATA_EGF_INDEX_HPP
+
+#include "data/pe_reader.hpp"
+
+#include "cio/mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// On-disk copy of the EGF bitmap tables, so a warm start doesn't walk each file's resource directory
+// Bitmaps are looked up straight out of the mapped index file
+//
+// File layout (all integers little-endian):
+//   header: "EOIX" u32 version, u32 file count
+//   file:   u32 egf id, u32 first record, u32 record count, u64 size, i64 mtime, u64 hash
+//   record: u32 bitmap id, u32 start, u32 size, u32 width, u32 height, u64 content hash
+//
+// Each file's records are sorted by bitmap id
+// Content hashes are util::fnv1a_64 of each resource's bytes, used to find duplicate bitmaps
+
+class EGF_Index
+{
+	public:
+		static constexpr char magic[4] = {'E', 'O', 'I', 'X'};
+		static constexpr std::uint32_t version = 2;
+
+		static constexpr std::size_t header_size = 12;
+		static constexpr std::size_t file_size = 36;
+		static constexpr std::size_t record_size = 28;
+
+		// Identifies the version of an EGF file that a table was read from
+		struct File_Key
+		{
+			std::uint64_t size = 0;
+			std::int64_t mtime = 0;
+
+			// See header_hash
+			std::uint64_t hash = 0;
+		};
+
+		class Table
+		{
+			private:
+				std::string_view m_records;
+
+			public:
+				Table() = default;
+
+				explicit Table(std::string_view records)
+					: m_records(records)
+				{ }
+
+				std::size_t size() const
+				{
+					return m_records.size() / record_size;
+				}
+
+				pe_reader::BitmapInfo operator[](std::size_t i) const;
+
+				std::optional<pe_reader::BitmapInfo> find(int id) const;
+
+				pe_reader::Bitmap_Table to_vector() const;
+		};
+
+		struct File
+		{
+			int id = 0;
+			File_Key key;
+			Table table;
+		};
+
+		// Used to write a new index
+		struct Entry
+		{
+			int id = 0;
+			File_Key key;
+			pe_reader::Bitmap_Table table;
+		};
+
+	private:
+		cio::mapped_file m_file;
+		std::vector<File> m_files;
+
+	public:
+		// Returns false if the file is missing or not a valid index
+		bool open(const char* filename);
+		void close();
+
+		// Null if the egf isn't in the index
+		const File* find(int egf_id) const;
+
+		std::size_t mapped_size() const { return m_file.size(); }
+
+		// Replaces the index file, which must not be open
+		static bool write(const char* filename, const std::vector<Entry>& entries);
+
+		// Hash of the first and last 64 KiB of an EGF file, which hold the PE headers and usually the resource directory
+		// Catches files changed without their size or modified time changing, without reading all of them
+		static std::uint64_t header_hash(std::string_view data);
+};
+
+#endif // EO_DATA_EGF_INDEX_HPP
@@ -1,5 +1,7 @@
 #include "eo_stream.hpp"
 
+#include <algorithm>
+
 EO_Stream_Reader::EO_Stream_Reader(std::string_view data)
 	: m_data(data)
 	, m_pos(0)
@@ -115,7 +117,7 @@ bool EO_Stream_Reader::unbroken() const
 
 void EO_Stream_Reader::seek(std::size_t offset)
 {
-	m_pos = std::max(length(), offset);
+	m_pos = std::min(length(), offset);
 }
 
 void EO_Stream_Reader::skip(long offset)
@@ -207,7 +209,7 @@ void EO_Stream_Builder::add_prefix_string(const std::string& str)
 
 void EO_Stream_Builder::seek(std::size_t offset)
 {
-	m_pos = std::max(length(), offset);
+	m_pos = std::min(length(), offset);
 }
 
 void EO_Stream_Builder::skip(long offset)
@@ -228,5 +230,5 @@ void EO_Stream_Builder::skip(long offset)
 
 void EO_Stream_Builder::seek_reverse(std::size_t offset)
 {
-	m_pos = length() - std::max(length(), offset);
+	m_pos = length() - std::min(length(), offset);
 }
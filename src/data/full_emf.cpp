@@ -2,6 +2,8 @@
 
 #include "eo_stream.hpp"
 
+#include <algorithm>
+
 void Full_EMF::decode_str(char* data, size_t n)
 {
 	for (size_t i = 0; i < n / 2; ++i)
@@ -24,86 +26,262 @@ void Full_EMF::decode_str(char* data, size_t n)
 
 void Full_EMF::unserialize(EO_Stream_Reader& reader)
 {
-	header.unserialize(reader);
-	decode_str(&header.name[0], header.name.length());
-	header.name = header.name.substr(0, header.name.find_first_of(0xFF));
+	Full_EMF_Parser parser(*this);
+	parser.feed(reader.get_end_string());
+}
 
-	++header.width;
-	++header.height;
+// EMF_File up to and including num_npcs
+static constexpr std::size_t emf_fixed_header_size = 47;
 
-	std::array<eo_short, 9> value{255, 255, 255, 255, 255, 255, 255, 255, 255};
+// Number of graphic layers, which follow the tile spec and warp sections
+static constexpr int emf_gfx_layers = 9;
 
-	m_meta.resize(header.width * header.height);
-	m_gfx.resize(header.width * header.height, value);
+static int last_char(std::string_view data)
+{
+	return eo_number_decode(eo_byte(data.back()));
+}
+
+Full_EMF_Parser::Full_EMF_Parser(Full_EMF& emf)
+	: m_emf(emf)
+	, m_need(emf_fixed_header_size)
+{ }
 
+bool Full_EMF_Parser::feed(std::string_view data)
+{
+	while (!data.empty() && m_state != done && m_state != failed)
 	{
-		int rows = reader.get_char();
-		for (int i = 0; i < rows; ++i)
+		std::string_view unit;
+
+		if (m_pending.empty() && data.size() >= m_need)
 		{
-			int y = reader.get_char();
-			int tiles = reader.get_char();
-			for (int ii = 0; ii < tiles; ++ii)
-			{
-				int x = reader.get_char();
-				int c = reader.get_char();
+			// Common case: the whole record is in this piece
+			unit = data.substr(0, m_need);
+			data.remove_prefix(m_need);
+		}
+		else
+		{
+			std::size_t n = std::min(m_need - m_pending.size(), data.size());
+			m_pending.append(data.data(), n);
+			data.remove_prefix(n);
 
-				if (x < header.width && y < header.height)
-					meta(x, y).spec = static_cast<EMF_Tile_Spec>(c);
-			}
+			if (m_pending.size() < m_need)
+				break;
+
+			unit = m_pending;
+		}
+
+		bool ok = step(unit);
+		m_pending.clear();
+
+		if (!ok)
+		{
+			m_state = failed;
+			return false;
 		}
 	}
 
+	return m_state != failed;
+}
+
+bool Full_EMF_Parser::finish() const
+{
+	// The sign section is absent from some maps
+	return m_state == done || (m_state == sign_count && m_pending.empty());
+}
+
+bool Full_EMF_Parser::step(std::string_view data)
+{
+	EO_Stream_Reader reader(data);
+
+	switch (m_state)
 	{
-		int rows = reader.get_char();
-		for (int i = 0; i < rows; ++i)
+		case header_fixed:
+			m_header.assign(data);
+			m_need = last_char(data) * EMF_NPC().byte_size() + 1;
+			m_state = header_npcs;
+			break;
+
+		case header_npcs:
+			m_header.append(data);
+			m_need = last_char(data) * EMF_Unknown().byte_size() + 1;
+			m_state = header_unknowns;
+			break;
+
+		case header_unknowns:
+			m_header.append(data);
+			m_need = last_char(data) * EMF_Item().byte_size();
+			m_state = header_items;
+
+			if (m_need == 0)
+				finish_header();
+
+			break;
+
+		case header_items:
+			m_header.append(data);
+			finish_header();
+			break;
+
+		case section_rows:
+			m_rows_left = reader.get_char();
+			next_row();
+			break;
+
+		case row:
+			m_y = reader.get_char();
+			m_tiles_left = reader.get_char();
+			next_tile();
+			break;
+
+		case tile:
 		{
-			int y = reader.get_char();
-			int tiles = reader.get_char();
-			for (int ii = 0; ii < tiles; ++ii)
+			auto&& header = m_emf.header;
+			int x = reader.get_char();
+			bool in_bounds = (x < header.width && m_y < header.height);
+
+			if (m_section == 0)
 			{
-				int x = reader.get_char();
-				EMF_Warp warp(reader);
+				int c = reader.get_char();
 
-				if (x < header.width && y < header.height)
-					meta(x, y).warp = warp;
+				if (in_bounds)
+					m_emf.meta(x, m_y).spec = static_cast<EMF_Tile_Spec>(c);
 			}
-		}
-	}
+			else if (m_section == 1)
+			{
+				EMF_Warp warp(reader);
 
-	for (int layer = 0; layer < 9; ++layer)
-	{
-		int rows = reader.get_char();
-		for (int i = 0; i < rows; ++i)
-		{
-			int y = reader.get_char();
-			int tiles = reader.get_char();
-			for (int ii = 0; ii < tiles; ++ii)
+				if (in_bounds)
+					m_emf.meta(x, m_y).warp = warp;
+			}
+			else
 			{
-				int x = reader.get_char();
 				int s = reader.get_short();
 
-				if (x < header.width && y < header.height)
-					gfx(x, y)[layer] = s;
+				if (in_bounds)
+					m_emf.gfx(x, m_y)[m_section - 2] = s;
 			}
+
+			next_tile();
+			break;
 		}
-	}
 
-	if (reader.remaining() > 0)
-	{
-		int signs = reader.get_char();
-		for (int i = 0; i < signs; ++i)
+		case sign_count:
+			m_signs_left = reader.get_char();
+			next_sign();
+			break;
+
+		case sign_head:
 		{
-			int x = reader.get_char();
-			int y = reader.get_char();
+			m_sign_x = reader.get_char();
+			m_sign_y = reader.get_char();
 			int length = reader.get_short() - 1;
-			std::string data = std::string(reader.get_fixed_string(length));
-			decode_str(&data[0], data.size());
-			int title_length = reader.get_char();
-			std::string title = data.substr(0, title_length);
-			std::string message = data.substr(title_length);
-
-			if (x < header.width && y < header.height)
-				meta(x, y).sign = std::pair<std::string, std::string>{title, message};
+
+			if (length < 0)
+				return false;
+
+			// Sign text followed by the title length
+			m_need = std::size_t(length) + 1;
+			m_state = sign_body;
+			break;
 		}
+
+		case sign_body:
+		{
+			auto&& header = m_emf.header;
+			std::string text(data.substr(0, data.size() - 1));
+			Full_EMF::decode_str(&text[0], text.size());
+			std::size_t title_length = std::min(std::size_t(last_char(data)), text.size());
+			std::string title = text.substr(0, title_length);
+			std::string message = text.substr(title_length);
+
+			if (m_sign_x < header.width && m_sign_y < header.height)
+				m_emf.meta(m_sign_x, m_sign_y).sign = std::pair<std::string, std::string>{title, message};
+
+			next_sign();
+			break;
+		}
+
+		default:
+			break;
 	}
+
+	return true;
+}
+
+void Full_EMF_Parser::finish_header()
+{
+	auto&& header = m_emf.header;
+
+	EO_Stream_Reader reader(m_header);
+	header.unserialize(reader);
+	std::string().swap(m_header);
+
+	Full_EMF::decode_str(&header.name[0], header.name.length());
+	header.name = header.name.substr(0, header.name.find_first_of(0xFF));
+
+	++header.width;
+	++header.height;
+
+	std::array<eo_short, 9> value{255, 255, 255, 255, 255, 255, 255, 255, 255};
+
+	m_emf.m_meta.assign(header.width * header.height, {});
+	m_emf.m_gfx.assign(header.width * header.height, value);
+
+	begin_section(0);
+}
+
+void Full_EMF_Parser::begin_section(int section)
+{
+	m_section = section;
+	m_need = 1;
+
+	if (section < 2 + emf_gfx_layers)
+		m_state = section_rows;
+	else
+		m_state = sign_count;
+}
+
+void Full_EMF_Parser::next_row()
+{
+	if (m_rows_left == 0)
+	{
+		begin_section(m_section + 1);
+		return;
+	}
+
+	--m_rows_left;
+	m_need = 2;
+	m_state = row;
+}
+
+void Full_EMF_Parser::next_tile()
+{
+	if (m_tiles_left == 0)
+	{
+		next_row();
+		return;
+	}
+
+	--m_tiles_left;
+	m_state = tile;
+
+	if (m_section == 0)
+		m_need = 2;
+	else if (m_section == 1)
+		m_need = 1 + EMF_Warp().byte_size();
+	else
+		m_need = 3;
+}
+
+void Full_EMF_Parser::next_sign()
+{
+	if (m_signs_left == 0)
+	{
+		m_state = done;
+		return;
+	}
+
+	--m_signs_left;
+	m_need = 4;
+	m_state = sign_head;
 }
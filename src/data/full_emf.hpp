@@ -1,10 +1,12 @@
-#ifndef EO_DATA_HPP
-#define EO_DATA_HPP
+#ifndef EO_DATA_FULL_EMF_HPP
+#define EO_DATA_FULL_EMF_HPP
 
 #include "eo_pub_protocol.hpp"
 
 #include <map>
 #include <optional>
+#include <string>
+#include <string_view>
 
 // Extends the auto-generated EMF_File with code to read the tile data
 struct Full_EMF
@@ -42,4 +44,58 @@ struct Full_EMF
 	void unserialize(EO_Stream_Reader& reader);
 };
 
-#endif // EO_DATA_HPP
+// Fills out a Full_EMF from data arriving in arbitrarily sized pieces
+// Only the bytes of a partially received record are held on to
+class Full_EMF_Parser
+{
+	private:
+		enum state_t
+		{
+			header_fixed,
+			header_npcs,
+			header_unknowns,
+			header_items,
+			section_rows,
+			row,
+			tile,
+			sign_count,
+			sign_head,
+			sign_body,
+			done,
+			failed
+		};
+
+		Full_EMF& m_emf;
+
+		state_t m_state = header_fixed;
+		std::size_t m_need;
+		std::string m_pending;
+		std::string m_header;
+
+		// 0 = tile specs, 1 = warps, 2+ = graphic layers
+		int m_section = 0;
+		int m_rows_left = 0;
+		int m_tiles_left = 0;
+		int m_y = 0;
+		int m_signs_left = 0;
+		int m_sign_x = 0;
+		int m_sign_y = 0;
+
+		bool step(std::string_view data);
+		void finish_header();
+		void begin_section(int section);
+		void next_row();
+		void next_tile();
+		void next_sign();
+
+	public:
+		explicit Full_EMF_Parser(Full_EMF& emf);
+
+		// Returns false once the data is found to be malformed
+		bool feed(std::string_view data);
+
+		// Returns true if a complete map was read
+		bool finish() const;
+};
+
+#endif // EO_DATA_FULL_EMF_HPP
@@ -0,0 +1,160 @@
+#include "gfx_archive.hpp"
+
+#include "util/int_pack.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#define TRACE_CTX "gfx_archive"
+
+GFX_Archive::Image GFX_Archive::image(std::size_t i) const
+{
+	const char* p = m_images.data() + i * image_size;
+
+	auto u32 = [p](int n) { return util::int_pack_32_le(p + n * 4); };
+
+	Image result;
+	result.egf_id = int(u32(0));
+	result.id = int(u32(1));
+	result.width = int(u32(2));
+	result.height = int(u32(3));
+	result.opaque = {int(u32(4)), int(u32(5)), int(u32(6)), int(u32(7))};
+	result.atlas_page = u32(8);
+	result.atlas_x = int(u32(9));
+	result.atlas_y = int(u32(10));
+
+	auto offset = util::int_pack_64_le(p + 48);
+	auto size = std::uint64_t(result.width) * std::uint64_t(result.height) * 4;
+	auto data = m_file.view();
+
+	// Checked when the archive was opened
+	result.pixels = data.substr(std::size_t(offset), std::size_t(size));
+
+	return result;
+}
+
+bool GFX_Archive::open(const char* filename)
+{
+	close();
+
+	if (!m_file.open(filename))
+		return false;
+
+	auto data = m_file.view();
+
+	auto fail = [&](const char* reason)
+	{
+		trace_log(filename << ": " << reason);
+		close();
+		return false;
+	};
+
+	if (data.size() < header_size
+	 || data.substr(0, sizeof magic) != std::string_view(magic, sizeof magic)
+	 || util::int_pack_32_le(&data[4]) != version)
+		return fail("not a graphics archive");
+
+	auto format = util::int_pack_32_le(&data[8]);
+
+	if (format != std::uint32_t(Pixel_Format::rgba) && format != std::uint32_t(Pixel_Format::bgra))
+		return fail("unknown pixel format");
+
+	m_format = Pixel_Format(format);
+	m_page_size = int(util::int_pack_32_le(&data[12]));
+	m_page_count = int(util::int_pack_32_le(&data[16]));
+
+	std::size_t source_count = util::int_pack_32_le(&data[20]);
+	std::size_t image_count = util::int_pack_32_le(&data[24]);
+	std::uint32_t color_key = util::int_pack_32_le(&data[28]);
+
+	if (color_key == no_key)
+		m_color_key.reset();
+	else
+		m_color_key = color_key & 0xFFFFFFU;
+
+	if (source_count > (data.size() - header_size) / source_size)
+		return fail("truncated");
+
+	std::size_t images_start = header_size + source_count * source_size;
+
+	if (image_count > (data.size() - images_start) / image_size)
+		return fail("truncated");
+
+	for (std::size_t i = 0; i < source_count; ++i)
+	{
+		const char* p = data.data() + header_size + i * source_size;
+
+		m_sources.push_back({
+			int(util::int_pack_32_le(p)),
+			util::int_pack_64_le(p + 8),
+			util::int_pack_64_le(p + 16)
+		});
+	}
+
+	m_images = data.substr(images_start, image_count * image_size);
+
+	// Checked once here, so lookups can trust the pixel offsets
+	for (std::size_t i = 0; i < image_count; ++i)
+	{
+		const char* p = m_images.data() + i * image_size;
+
+		std::uint64_t width = util::int_pack_32_le(p + 8);
+		std::uint64_t height = util::int_pack_32_le(p + 12);
+		std::uint64_t offset = util::int_pack_64_le(p + 48);
+
+		if (width > 0xFFFF || height > 0xFFFF
+		 || offset > data.size() || width * height * 4 > data.size() - offset)
+			return fail("image out of bounds");
+	}
+
+	return true;
+}
+
+void GFX_Archive::close()
+{
+	m_sources.clear();
+	m_images = {};
+	m_file.close();
+}
+
+const GFX_Archive::Source* GFX_Archive::source(int egf_id) const
+{
+	auto it = std::find_if(m_sources.begin(), m_sources.end(),
+		[egf_id](const Source& source) { return source.egf_id == egf_id; });
+
+	if (it == m_sources.end())
+		return nullptr;
+
+	return &*it;
+}
+
+std::optional<GFX_Archive::Image> GFX_Archive::find(int egf_id, int id) const
+{
+	auto key = [this](std::size_t i)
+	{
+		const char* p = m_images.data() + i * image_size;
+		return std::make_pair(int(util::int_pack_32_le(p)), int(util::int_pack_32_le(p + 4)));
+	};
+
+	auto target = std::make_pair(egf_id, id);
+
+	std::size_t lo = 0;
+	std::size_t hi = size();
+
+	while (lo < hi)
+	{
+		std::size_t mid = lo + (hi - lo) / 2;
+
+		if (key(mid) < target)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == size() || key(lo) != target)
+		return std::nullopt;
+
+	return image(lo);
+}
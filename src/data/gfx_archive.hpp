@@ -0,0 +1,123 @@
+#ifndef EO_DATA_GFX_ARCHIVE_HPP
+#define EO_DATA_GFX_ARCHIVE_HPP
+
+#include "gfx/pixel_format.hpp"
+
+#include "cio/mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Every EGF graphic decoded ahead of time by tools/egf_pack, to be uploaded straight out of a mapping
+//
+// File layout (all integers little-endian):
+//   header: "EOGA" u32 version, u32 pixel format, u32 atlas page size, u32 atlas page count,
+//           u32 source count, u32 image count, u32 color key
+//   source: u32 egf id, u32 reserved, u64 size, u64 hash
+//   image:  u32 egf id, u32 bitmap id, u32 width, u32 height,
+//           u32 opaque x, u32 opaque y, u32 opaque width, u32 opaque height,
+//           u32 atlas page, u32 atlas x, u32 atlas y, u32 reserved, u64 pixel offset
+//   pixels: width * height * 4 bytes per image, at 16 byte aligned offsets from the start of the file
+//
+// Sources identify the EGF files the images were decoded from, see EGF_Index::header_hash
+// Images are sorted by egf id then bitmap id
+// Pixels are premultiplied, those which matched the color key are all zero
+// The color key is 0xRRGGBB, or no_key if none was used
+// The opaque box bounds every pixel with non-zero alpha, and is all zero for a blank image
+// The atlas places each image's opaque box on a page, atlas page is no_page if it didn't fit
+// Images decoded from identical bitmaps share their pixels and atlas space
+
+class GFX_Archive
+{
+	public:
+		static constexpr char magic[4] = {'E', 'O', 'G', 'A'};
+		static constexpr std::uint32_t version = 2;
+
+		static constexpr std::size_t header_size = 32;
+		static constexpr std::size_t source_size = 24;
+		static constexpr std::size_t image_size = 56;
+		static constexpr std::size_t pixel_alignment = 16;
+
+		static constexpr std::uint32_t no_page = 0xFFFFFFFFU;
+		static constexpr std::uint32_t no_key = 0xFFFFFFFFU;
+
+		struct Rect
+		{
+			int x = 0;
+			int y = 0;
+			int width = 0;
+			int height = 0;
+		};
+
+		struct Source
+		{
+			int egf_id = 0;
+			std::uint64_t size = 0;
+			std::uint64_t hash = 0;
+		};
+
+		struct Image
+		{
+			int egf_id = 0;
+			int id = 0;
+			int width = 0;
+			int height = 0;
+
+			Rect opaque;
+
+			std::uint32_t atlas_page = no_page;
+			int atlas_x = 0;
+			int atlas_y = 0;
+
+			// Points in to the archive's mapping
+			std::string_view pixels;
+		};
+
+	private:
+		cio::mapped_file m_file;
+
+		Pixel_Format m_format = Pixel_Format::rgba;
+		int m_page_size = 0;
+		int m_page_count = 0;
+		std::optional<std::uint32_t> m_color_key;
+
+		std::vector<Source> m_sources;
+		std::string_view m_images;
+
+		Image image(std::size_t i) const;
+
+	public:
+		// Returns false if the file is missing or not a valid archive
+		bool open(const char* filename);
+		void close();
+
+		bool is_open() const
+		{
+			return m_file.is_open();
+		}
+
+		std::size_t mapped_size() const { return m_file.size(); }
+		std::size_t resident_size() const { return m_file.resident_size(); }
+
+		Pixel_Format format() const { return m_format; }
+		int page_size() const { return m_page_size; }
+		int page_count() const { return m_page_count; }
+		std::optional<std::uint32_t> color_key() const { return m_color_key; }
+
+		const std::vector<Source>& sources() const { return m_sources; }
+
+		// Null if the egf wasn't packed
+		const Source* source(int egf_id) const;
+
+		std::size_t size() const
+		{
+			return m_images.size() / image_size;
+		}
+
+		std::optional<Image> find(int egf_id, int id) const;
+};
+
+#endif // EO_DATA_GFX_ARCHIVE_HPP
@@ -1,118 +1,64 @@
 #include "pe_reader.hpp"
 
-#include "dib_reader.hpp"
-
 #include "util/int_pack.hpp"
 
 #include <cstring>
-#include <vector>
 
-std::uint16_t pe_reader::read_u16_le()
+std::uint16_t pe_reader::read_u16_le(std::size_t offset) const noexcept
 {
-	char buf[2];
-
-	if (file.read(buf, 2) == 2)
-	{
-		return util::int_pack_16_le(buf[0], buf[1]);
-	}
+	if (offset > data.size() || data.size() - offset < 2)
+		return 0;
 
-	return 0;
+	return util::int_pack_16_le(data.data() + offset);
 }
 
-std::uint32_t pe_reader::read_u32_le()
+std::uint32_t pe_reader::read_u32_le(std::size_t offset) const noexcept
 {
-	char buf[4];
+	if (offset > data.size() || data.size() - offset < 4)
+		return 0;
 
-	if (file.read(buf, 4) == 4)
-	{
-		return util::int_pack_32_le(buf[0], buf[1], buf[2], buf[3]);
-	}
-
-	return 0;
-}
-
-pe_reader::ResourceDirectory pe_reader::read_ResourceDirectory()
-{
-	return pe_reader::ResourceDirectory{
-		read_u32_le(),
-		read_u32_le(),
-		read_u16_le(),
-		read_u16_le(),
-		read_u16_le(),
-		read_u16_le()
-	};
-}
-
-pe_reader::ResourceDirectoryEntry pe_reader::read_ResourceDirectoryEntry()
-{
-	return pe_reader::ResourceDirectoryEntry{
-		pe_reader::ResourceType(read_u32_le()),
-		read_u32_le()
-	};
-}
-
-pe_reader::ResourceDataEntry pe_reader::read_ResourceDataEntry()
-{
-	return pe_reader::ResourceDataEntry{
-		read_u32_le(),
-		read_u32_le(),
-		read_u32_le(),
-		read_u32_le()
-	};
+	return util::int_pack_32_le(data.data() + offset);
 }
 
 bool pe_reader::read_header()
 {
-	char buf[8];
+	std::size_t pe_header_address = read_u16_le(0x3C);
 
-	file.seek(0x3C);
-	std::uint16_t pe_header_address = read_u16_le();
-
-	file.skip(pe_header_address - 0x3C - 0x02);
-	file.read(buf, 4);
-
-	if (std::memcmp(buf, "PE\0", 4) != 0)
+	if (resource(pe_header_address, 4) != std::string_view("PE\0\0", 4))
 		return false;
 
-	file.skip(0x02);
-	std::uint16_t sections = read_u16_le();
+	std::uint16_t sections = read_u16_le(pe_header_address + 0x06);
 
-	file.skip(0x78 - 0x04 + 0x0C);
-	virtual_address = read_u32_le();
+	virtual_address = read_u32_le(pe_header_address + 0x88);
 
-	file.skip(0x6C + 0x08 + 0x04);
+	// Section headers are 0x28 bytes, starting with the virtual address at +0x0C
+	std::size_t section = pe_header_address + 0x104;
 
-	for (unsigned int i = 0; i < sections; ++i)
+	for (unsigned int i = 0; i < sections; ++i, section += 0x28)
 	{
-		std::uint32_t check_virtual_address = read_u32_le();
-
-		if (check_virtual_address == virtual_address)
+		if (read_u32_le(section) == virtual_address)
 		{
-			file.skip(0x04);
-
-			root_address = read_u32_le();
+			root_address = read_u32_le(section + 0x08);
 			break;
 		}
-
-		file.skip(0x24);
 	}
 
 	if (!root_address)
 		return false;
 
-	file.seek(root_address);
-
-	ResourceDirectory root_directory = read_ResourceDirectory();
-
-	unsigned int directory_entries = root_directory.NumberOfNamedEntries + root_directory.NumberOfIdEntries;
-
-	ResourceDirectoryEntry entry;
+	// Named and ID entry counts are at the end of the directory header
+	unsigned int directory_entries = read_u16_le(root_address + 12) + read_u16_le(root_address + 14);
 
 	for (unsigned int i = 0; i < directory_entries; ++i)
 	{
-		entry = read_ResourceDirectoryEntry();
+		std::size_t entry_address = root_address + 16 + i * 8;
 
-		if (std::uint32_t(entry.ResourceType_) < 0x80000000 && entry.ResourceType_ == ResourceType::Bitmap)
+		ResourceDirectoryEntry entry{
+			ResourceType(read_u32_le(entry_address)),
+			read_u32_le(entry_address + 4)
+		};
+
+		if (entry.ResourceType_ == ResourceType::Bitmap)
 		{
 			if (entry.SubDirectoryOffset < 0x80000000)
 				return false;
@@ -121,8 +67,6 @@ bool pe_reader::read_header()
 
 			bitmap_directory_entry = entry;
 
-			file.skip(8 * (directory_entries - i - 1));
-
 			break;
 		}
 	}
@@ -130,80 +74,57 @@ bool pe_reader::read_header()
 	return true;
 }
 
-std::map<int, pe_reader::BitmapInfo> pe_reader::read_bitmap_table()
+pe_reader::Bitmap_Table pe_reader::read_bitmap_table()
 {
-	char buf[16];
-
-	std::map<int, BitmapInfo> bitmap_pointers;
+	Bitmap_Table bitmap_table;
 
 	if (bitmap_directory_entry.ResourceType_ != ResourceType::Bitmap)
-		return bitmap_pointers;
+		return bitmap_table;
 
-	file.seek(root_address + bitmap_directory_entry.SubDirectoryOffset);
+	std::size_t directory_address = root_address + bitmap_directory_entry.SubDirectoryOffset;
 
-	ResourceDirectory bitmap_directory;
-	file.read(buf, 16);
-	bitmap_directory.NumberOfNamedEntries = util::int_pack_16_le(buf + 12);
-	bitmap_directory.NumberOfIdEntries = util::int_pack_16_le(buf + 14);
+	unsigned int directory_entries = read_u16_le(directory_address + 12) + read_u16_le(directory_address + 14);
 
-	unsigned int directory_entries = bitmap_directory.NumberOfNamedEntries + bitmap_directory.NumberOfIdEntries;
-
-	std::vector<ResourceDirectoryEntry> bitmap_entries;
-	bitmap_entries.reserve(directory_entries);
-
-	ResourceDirectoryEntry entry;
+	bitmap_table.reserve(directory_entries);
 
 	for (unsigned int i = 0; i < directory_entries; ++i)
 	{
-		file.read(buf, 8);
-		entry.ResourceType_ = ResourceType(util::int_pack_32_le(buf));
-		entry.SubDirectoryOffset = util::int_pack_32_le(buf + 4);
+		std::size_t entry_address = directory_address + 16 + i * 8;
 
-		if (entry.SubDirectoryOffset > 0x80000000)
-		{
-			entry.SubDirectoryOffset -= 0x80000000;
-			bitmap_entries.push_back(entry);
-		}
-	}
-
-	ResourceDataEntry data_entry;
+		int id = int(read_u32_le(entry_address));
+		std::uint32_t sub_directory_offset = read_u32_le(entry_address + 4);
 
-	for (auto it = bitmap_entries.begin(); it != bitmap_entries.end(); ++it)
-	{
-		file.seek(root_address + it->SubDirectoryOffset + 16);
+		if (sub_directory_offset <= 0x80000000)
+			continue;
 
-		file.read(buf, 8);
-		entry.SubDirectoryOffset = util::int_pack_32_le(buf + 4);
+		sub_directory_offset -= 0x80000000;
 
-		file.seek(root_address + entry.SubDirectoryOffset);
+		// The first language entry of the bitmap's own directory points to its data entry
+		std::uint32_t data_entry_offset = read_u32_le(root_address + sub_directory_offset + 16 + 4);
+		std::size_t data_entry_address = root_address + data_entry_offset;
 
-		file.read(buf, 16);
-		data_entry.OffsetToData = util::int_pack_32_le(buf);
-		data_entry.Size = util::int_pack_32_le(buf + 4);
+		std::uint32_t offset_to_data = read_u32_le(data_entry_address);
+		std::uint32_t data_size = read_u32_le(data_entry_address + 4);
 
-		std::size_t start = data_entry.OffsetToData - virtual_address + root_address;
-		std::size_t size = data_entry.Size;
+		std::size_t start = std::size_t(offset_to_data) - virtual_address + root_address;
+		std::size_t size = data_size;
 
-		file.seek(start + 4);
+		if (resource(start, size).empty())
+			continue;
 
-		int width = read_u32_le();
-		int height = read_u32_le();
+		int width = read_u32_le(start + 4);
+		int height = read_u32_le(start + 8);
 
-		std::size_t type = std::uint32_t(it->ResourceType_);
-
-		bitmap_pointers.insert({type, {start, size, width, height}});
+		bitmap_table.push_back({id, start, size, width, height});
 	}
 
-	return bitmap_pointers;
-}
-
-bool pe_reader::read_resource(char* buf, std::size_t start, std::size_t size)
-{
-	if (!file.seek(start))
-		return false;
+	// The directory is normally in order already
+	std::stable_sort(bitmap_table.begin(), bitmap_table.end(),
+		[](const BitmapInfo& a, const BitmapInfo& b) { return a.id < b.id; });
 
-	if (file.read(buf, size) != size)
-		return false;
+	// Keep the first of any duplicate IDs, as std::map::insert did
+	bitmap_table.erase(std::unique(bitmap_table.begin(), bitmap_table.end(),
+		[](const BitmapInfo& a, const BitmapInfo& b) { return a.id == b.id; }), bitmap_table.end());
 
-	return true;
+	return bitmap_table;
 }
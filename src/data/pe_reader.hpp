@@ -1,24 +1,32 @@
 #ifndef EO_PE_READER_HPP
 #define EO_PE_READER_HPP
 
-#include "cio/cio.hpp"
-
 #include <algorithm>
 #include <cstdint>
-#include <map>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+// Reads bitmap resources from a PE file held in memory, usually a cio::mapped_file
+// Resources are returned as views in to that memory, which must outlive the reader
 class pe_reader
 {
 	public:
 		struct BitmapInfo
 		{
+			int id;
 			std::size_t start;
 			std::size_t size;
 			int width;
 			int height;
+
+			// FNV-1a of the resource bytes, 0 if it's not been hashed
+			std::uint64_t hash = 0;
 		};
 
+		// Sorted by id
+		using Bitmap_Table = std::vector<BitmapInfo>;
+
 	private:
 		enum class ResourceType : std::uint32_t
 		{
@@ -38,62 +46,56 @@ class pe_reader
 			VersionInformation = 16
 		};
 
-		struct ResourceDirectory
-		{
-			std::uint32_t Characteristics;
-			std::uint32_t TimeDateStamp;
-			std::uint16_t MajorVersion;
-			std::uint16_t MinorVersion;
-			std::uint16_t NumberOfNamedEntries;
-			std::uint16_t NumberOfIdEntries;
-		};
-
 		struct ResourceDirectoryEntry
 		{
 			ResourceType ResourceType_;
 			std::uint32_t SubDirectoryOffset;
 		};
 
-		struct ResourceDataEntry
-		{
-			std::uint32_t OffsetToData;
-			std::uint32_t Size;
-			std::uint32_t CodePage;
-			std::uint32_t unused;
-		};
+		std::string_view data;
 
-		cio::stream file;
-		
 		std::uint32_t root_address = 0;
 		std::uint32_t virtual_address = 0;
 		ResourceDirectoryEntry bitmap_directory_entry = {ResourceType{}, 0};
 
-		std::uint16_t read_u16_le();
-		std::uint32_t read_u32_le();
-
-		ResourceDirectory read_ResourceDirectory();
-		ResourceDirectoryEntry read_ResourceDirectoryEntry();
-		ResourceDataEntry read_ResourceDataEntry();
+		// Reads past the end return 0
+		std::uint16_t read_u16_le(std::size_t offset) const noexcept;
+		std::uint32_t read_u32_le(std::size_t offset) const noexcept;
 
 	public:
-		pe_reader(cio::stream&& file)
-			: file(std::move(file))
+		pe_reader() = default;
+
+		explicit pe_reader(std::string_view data)
+			: data(data)
 		{ }
 
 		bool read_header();
 
-		std::map<int, BitmapInfo> read_bitmap_table();
+		Bitmap_Table read_bitmap_table();
 
-		bool read_resource(char* buf, std::size_t start, std::size_t size);
+		// Bytes of a resource within the file, empty if it runs past the end
+		std::string_view resource(std::size_t start, std::size_t size) const noexcept
+		{
+			if (start > data.size() || size > data.size() - start)
+				return {};
 
-		cio::stream& get_file()
+			return data.substr(start, size);
+		}
+
+		static const BitmapInfo* find(const Bitmap_Table& table, int id)
 		{
-			return file;
+			auto it = std::lower_bound(table.begin(), table.end(), id,
+				[](const BitmapInfo& info, int id) { return info.id < id; });
+
+			if (it == table.end() || it->id != id)
+				return nullptr;
+
+			return &*it;
 		}
 
-		cio::stream&& finish()
+		std::string_view get_data() const
 		{
-			return std::move(file);
+			return data;
 		}
 };
 
@@ -2,9 +2,44 @@
 
 #include "engine/engine_allegro.hpp"
 
+#include <algorithm>
+
 Engine::~Engine()
 { }
 
+Engine::Graphic Engine::load_pixels(const char* pixels, unsigned short width, unsigned short height,
+                                    Pixel_Format format, std::ptrdiff_t pitch)
+{
+	std::size_t row_size = std::size_t(width) * 4;
+
+	if (pitch == 0)
+		pitch = std::ptrdiff_t(row_size);
+
+	return create_graphic(width, height, [=](char* dest, std::ptrdiff_t dest_pitch, Pixel_Format dest_format)
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			const char* src = pixels + pitch * y;
+			char* row = dest + dest_pitch * y;
+
+			if (dest_format == format)
+			{
+				std::copy_n(src, row_size, row);
+				continue;
+			}
+
+			// rgba <-> bgra
+			for (std::size_t i = 0; i < row_size; i += 4)
+			{
+				row[i]     = src[i + 2];
+				row[i + 1] = src[i + 1];
+				row[i + 2] = src[i];
+				row[i + 3] = src[i + 3];
+			}
+		}
+	});
+}
+
 // Global object
 
 Engine* g_engine;
@@ -1,8 +1,14 @@
 #ifndef EO_ENGINE_HPP
 #define EO_ENGINE_HPP
 
+#include "gfx/pixel_format.hpp"
+#include "util/function.hpp"
+
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <optional>
 
 class Draw_Buffer;
 
@@ -44,13 +50,32 @@ class Engine
 				operator bool() const { return m_handle != nullptr; }
 		};
 
+		// Fills in the rows of a new graphic: dest is the first row and each row is pitch bytes after the last
+		// Rows are 4 bytes per pixel in the given format, which is usually the engine's own
+		using Pixel_Writer = util::function<void(char* dest, std::ptrdiff_t pitch, Pixel_Format format)>;
+
 		virtual ~Engine();
 
 		// Creates a blank graphic to be used with render_to_target
 		virtual Graphic create_texture(unsigned short width, unsigned short height) = 0;
 
 		// We have a dedicated load_bmp function to take advantage of Allegro's BMP loader
-		virtual Graphic load_bmp(const char* bmp_start, std::size_t bmp_size) = 0;
+		// Pixels of the 0xRRGGBB color key become transparent
+		virtual Graphic load_bmp(const char* bmp_start, std::size_t bmp_size, std::optional<std::uint32_t> color_key) = 0;
+
+		// The format graphics are stored in, which create_graphic writes without a conversion
+		// Until the display is created this is only a guess, which may change
+		virtual Pixel_Format native_format() = 0;
+
+		// Creates a graphic and has write fill in its pixels directly
+		// Pixels must have premultiplied alpha, as that's how graphics are drawn
+		virtual Graphic create_graphic(unsigned short width, unsigned short height, const Pixel_Writer& write) = 0;
+
+		// Uploads an already decoded image with 4 bytes per pixel, each row pitch bytes after the last
+		// A pitch of zero means there's no padding between rows
+		// As with create_graphic, pixels must have premultiplied alpha
+		Graphic load_pixels(const char* pixels, unsigned short width, unsigned short height, Pixel_Format format,
+		                    std::ptrdiff_t pitch = 0);
 
 		// renders to the "display", as determined by the App class
 		virtual void render(Draw_Buffer&) = 0;
@@ -7,6 +7,8 @@
 #include "alsmart/memfile.hpp"
 
 #include <allegro5/allegro_primitives.h>
+
+#include <optional>
 #include <stack>
 
 namespace
@@ -21,6 +23,23 @@ namespace
 		return static_cast<ALLEGRO_BITMAP*>(graphic.handle().get());
 	}
 
+	// Allegro names formats by component order in a native-endian word, this assumes little-endian
+	std::optional<Pixel_Format> pixel_format(int al_format)
+	{
+		switch (al_format)
+		{
+			case ALLEGRO_PIXEL_FORMAT_ARGB_8888:
+				return Pixel_Format::bgra;
+
+			case ALLEGRO_PIXEL_FORMAT_ABGR_8888:
+			case ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE:
+				return Pixel_Format::rgba;
+
+			default:
+				return std::nullopt;
+		}
+	}
+
 	struct Draw_Render_Visitor
 	{
 		struct clip_rect
@@ -112,7 +131,7 @@ Engine::Graphic Engine_Allegro::create_texture(unsigned short width, unsigned sh
 	return Graphic(std::static_pointer_cast<void>(bmp), width, height);
 }
 
-Engine::Graphic Engine_Allegro::load_bmp(const char* bmp_start, std::size_t bmp_size)
+Engine::Graphic Engine_Allegro::load_bmp(const char* bmp_start, std::size_t bmp_size, std::optional<std::uint32_t> color_key)
 {
 	alsmart::unique_bitmap_flags flag_lock(m_accel ? ALLEGRO_VIDEO_BITMAP : ALLEGRO_MEMORY_BITMAP);
 
@@ -120,18 +139,78 @@ Engine::Graphic Engine_Allegro::load_bmp(const char* bmp_start, std::size_t bmp_
 	auto f = alsmart::open_memfile_unique(mem, bmp_size, "r");
 	auto bmp = alsmart::load_bitmap_f_shared(f.get(), ".bmp");
 
+	if (!bmp)
+		return {};
+
+	// Allegro loads bitmaps premultiplied, and masked pixels come out all zero
+	if (color_key)
+		al_convert_mask_to_alpha(bmp.get(), al_map_rgb((*color_key >> 16) & 0xFF, (*color_key >> 8) & 0xFF, *color_key & 0xFF));
+
 	unsigned short width = al_get_bitmap_width(bmp.get());
 	unsigned short height = al_get_bitmap_height(bmp.get());
 
 	return Graphic(std::static_pointer_cast<void>(bmp), width, height);
 }
 
+Pixel_Format Engine_Allegro::native_format()
+{
+	// Video bitmaps only take on the display's format once there is one, so don't cache until then
+	if (!al_get_current_display())
+		return Pixel_Format::rgba;
+
+	if (!m_native_format)
+	{
+		alsmart::unique_bitmap_flags flag_lock(m_accel ? ALLEGRO_VIDEO_BITMAP : ALLEGRO_MEMORY_BITMAP);
+
+		auto bmp = alsmart::create_bitmap_shared(1, 1);
+		auto format = bmp ? pixel_format(al_get_bitmap_format(bmp.get())) : std::nullopt;
+
+		m_native_format = format.value_or(Pixel_Format::rgba);
+	}
+
+	return *m_native_format;
+}
+
+Engine::Graphic Engine_Allegro::create_graphic(unsigned short width, unsigned short height,
+                                               const Pixel_Writer& write)
+{
+	alsmart::unique_bitmap_flags flag_lock(m_accel ? ALLEGRO_VIDEO_BITMAP : ALLEGRO_MEMORY_BITMAP);
+
+	auto bmp = alsmart::create_bitmap_shared(width, height);
+
+	if (!bmp)
+		return {};
+
+	// Written in the bitmap's own format when possible, so Allegro has nothing to convert on unlock
+	auto lock = al_lock_bitmap(bmp.get(), ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
+	auto format = lock ? pixel_format(lock->format) : std::nullopt;
+
+	if (lock && !format)
+	{
+		al_unlock_bitmap(bmp.get());
+		lock = al_lock_bitmap(bmp.get(), ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+		format = Pixel_Format::rgba;
+	}
+
+	if (!lock)
+		return {};
+
+	write(static_cast<char*>(lock->data), lock->pitch, *format);
+
+	al_unlock_bitmap(bmp.get());
+
+	return Graphic(std::static_pointer_cast<void>(bmp), width, height);
+}
+
 void Engine_Allegro::render(Draw_Buffer& draw_buffer)
 {
 	//print_draw_commands(draw_buffer);
 
 	Draw_Render_Visitor v;
 
+	// Allegro's default, spelled out as every graphic is loaded with premultiplied alpha
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+
 	for (auto& cmd : draw_buffer.m_cmd_buffer)
 		std::visit(v, cmd);
 
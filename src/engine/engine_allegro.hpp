@@ -3,17 +3,24 @@
 
 #include "engine.hpp"
 
+#include <optional>
+
 class Engine_Allegro : public Engine
 {
 	private:
 		bool m_accel = false;
 
+		// Found by creating a bitmap, on first use
+		std::optional<Pixel_Format> m_native_format;
+
 	public:
 		Engine_Allegro();
 		virtual ~Engine_Allegro();
 
 		virtual Graphic create_texture(unsigned short width, unsigned short height);
-		virtual Graphic load_bmp(const char* bmp_start, std::size_t bmp_size);
+		virtual Graphic load_bmp(const char* bmp_start, std::size_t bmp_size, std::optional<std::uint32_t> color_key);
+		virtual Pixel_Format native_format();
+		virtual Graphic create_graphic(unsigned short width, unsigned short height, const Pixel_Writer& write);
 
 		virtual void render(Draw_Buffer&);
 		virtual void render_to_target(Graphic& target, Draw_Buffer& draw_buffer);
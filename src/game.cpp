@@ -1,9 +1,13 @@
 #include "game.hpp"
 
+#include "config.hpp"
+#include "data.hpp"
 #include "gfx/draw_buffer.hpp"
 
 #include "trace.hpp"
 
+#include <chrono>
+
 #define TRACE_CTX "game"
 
 void Game::handle_connect()
@@ -16,10 +20,6 @@ void Game::handle_disconnect()
 	trace_log("Disconnected");
 }
 
-void Game::handle_packet(Server_Packet& packet)
-{
-}
-
 void Game::handle_key_char(AppChar c)
 {
 	//trace_log("Char " << c << "(" << int(c) << ")");
@@ -54,9 +54,26 @@ void Game::handle_window_close()
 
 void Game::handle_tick()
 {
+	m_netclient.poll();
+	g_data->upload_prefetched();
+	write_memory_stats();
 	draw();
 }
 
+void Game::write_memory_stats()
+{
+	if (g_config.MemoryStatsFile[0] == '\0' || g_config.MemoryStatsInterval <= 0)
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+
+	if (now < m_memory_stats_time)
+		return;
+
+	g_data->write_memory_stats(g_config.MemoryStatsFile);
+	m_memory_stats_time = now + std::chrono::seconds(g_config.MemoryStatsInterval);
+}
+
 void Game::draw()
 {
 	Draw_Buffer drawbuf;
@@ -87,8 +104,6 @@ Game::Game()
 			handle_disconnect();
 	});
 
-	connect_this(m_netclient.sig_incoming_packet, &Game::handle_packet);
-
 	connect_this(m_app.sig_key_char, &Game::handle_key_char);
 	connect_this(m_app.sig_key_up, &Game::handle_key_up);
 	connect_this(m_app.sig_key_down, &Game::handle_key_down);
@@ -100,6 +115,14 @@ Game::Game()
 	connect_this(m_app.sig_window_close, &Game::handle_window_close);
 
 	connect_this(m_app.sig_tick, &Game::handle_tick);
+
+	// TODO: stream file replies to the cache with a Net_Download once the login is driven by Login_Sequence,
+	//       which is what tells the sink which map a File_Map reply holds
+
+	m_netclient.set_ping_interval(std::chrono::milliseconds(g_config.PingInterval));
+
+	if (g_config.CaptureFile[0] != '\0')
+		m_netclient.start_capture(g_config.CaptureFile);
 }
 
 Game::~Game()
@@ -7,6 +7,7 @@
 #include "app.hpp"
 #include "netclient.hpp"
 
+#include <chrono>
 #include <memory>
 
 class Game
@@ -17,9 +18,11 @@ class Game
 		App m_app;
 		unsigned m_tick = 0;
 
+		// When the next line is due in g_config.MemoryStatsFile
+		std::chrono::steady_clock::time_point m_memory_stats_time;
+
 		void handle_connect();
 		void handle_disconnect();
-		void handle_packet(Server_Packet& packet);
 
 		void handle_key_char(AppChar c);
 		void handle_key_down(AppKey key);
@@ -37,6 +40,7 @@ class Game
 		void handle_window_close();
 
 		void handle_tick();
+		void write_memory_stats();
 
 		void draw();
 
@@ -0,0 +1,82 @@
+#include "graphic_cache.hpp"
+
+Graphic_Cache::Graphic_Cache(std::size_t budget)
+	: m_budget(budget)
+{ }
+
+void Graphic_Cache::evict()
+{
+	while (m_stats.bytes > m_budget && !m_lru.empty())
+	{
+		auto&& entry = m_lru.back();
+
+		m_stats.bytes -= entry.cost;
+		++m_stats.evictions;
+
+		m_index.erase(entry.key);
+		m_lru.pop_back();
+	}
+
+	m_stats.entries = m_lru.size();
+}
+
+void Graphic_Cache::set_budget(std::size_t budget)
+{
+	m_budget = budget;
+	evict();
+}
+
+Engine::Graphic* Graphic_Cache::find(std::uint64_t key)
+{
+	auto it = m_index.find(key);
+
+	if (it == m_index.end())
+	{
+		++m_stats.misses;
+		return nullptr;
+	}
+
+	++m_stats.hits;
+
+	// Move to the front without invalidating the index
+	m_lru.splice(m_lru.begin(), m_lru, it->second);
+
+	return &it->second->graphic;
+}
+
+void Graphic_Cache::insert(std::uint64_t key, Engine::Graphic graphic, std::size_t cost)
+{
+	if (m_budget == 0)
+		return;
+
+	auto it = m_index.find(key);
+
+	if (it != m_index.end())
+	{
+		m_stats.bytes -= it->second->cost;
+		m_lru.erase(it->second);
+		m_index.erase(it);
+	}
+
+	m_lru.push_front({key, std::move(graphic), cost});
+	m_index.emplace(key, m_lru.begin());
+	m_stats.bytes += cost;
+
+	evict();
+}
+
+void Graphic_Cache::clear()
+{
+	m_lru.clear();
+	m_index.clear();
+
+	m_stats.entries = 0;
+	m_stats.bytes = 0;
+}
+
+Graphic_Cache::Stats Graphic_Cache::stats() const
+{
+	Stats result = m_stats;
+	result.budget = m_budget;
+	return result;
+}
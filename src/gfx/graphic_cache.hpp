@@ -0,0 +1,84 @@
+#ifndef EO_GRAPHIC_CACHE_HPP
+#define EO_GRAPHIC_CACHE_HPP
+
+#include "engine.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+// Keeps recently used graphics loaded, up to a budget in bytes
+// The least recently used graphics are released first
+// Graphics still referenced elsewhere stay alive until those references go
+// Like the engine, this should only be used from the main thread
+
+class Graphic_Cache
+{
+	public:
+		struct Stats
+		{
+			std::uint64_t hits = 0;
+			std::uint64_t misses = 0;
+			std::uint64_t evictions = 0;
+
+			std::size_t entries = 0;
+			std::size_t bytes = 0;
+			std::size_t budget = 0;
+		};
+
+	private:
+		struct Entry
+		{
+			std::uint64_t key;
+			Engine::Graphic graphic;
+			std::size_t cost;
+		};
+
+		// Most recently used first
+		std::list<Entry> m_lru;
+		std::unordered_map<std::uint64_t, std::list<Entry>::iterator> m_index;
+
+		std::size_t m_budget;
+		Stats m_stats;
+
+		void evict();
+
+	public:
+		explicit Graphic_Cache(std::size_t budget = 0);
+
+		// Zero disables the cache
+		void set_budget(std::size_t budget);
+
+		// Returns null and counts a miss if the graphic isn't cached
+		Engine::Graphic* find(std::uint64_t key);
+
+		// Unlike find, doesn't count as a use of the graphic
+		bool contains(std::uint64_t key) const
+		{
+			return m_index.find(key) != m_index.end();
+		}
+
+		// cost is usually the graphic's size once decoded
+		void insert(std::uint64_t key, Engine::Graphic graphic, std::size_t cost);
+
+		void clear();
+
+		Stats stats() const;
+
+		// Calls f(key, graphic, cost) for each cached graphic, most recently used first
+		// Doesn't count as a use of any of them
+		template <class F> void for_each(F&& f) const
+		{
+			for (auto&& entry : m_lru)
+				f(entry.key, entry.graphic, entry.cost);
+		}
+
+		// Decoded size of a graphic at 32 bits per pixel
+		static std::size_t cost_of(const Engine::Graphic& graphic)
+		{
+			return std::size_t(graphic.width()) * std::size_t(graphic.height()) * 4;
+		}
+};
+
+#endif // EO_GRAPHIC_CACHE_HPP
@@ -0,0 +1,164 @@
+#include "graphic_loader.hpp"
+
+#include <algorithm>
+#include <utility>
+
+Graphic_Loader::Graphic_Loader(decode_fn decode, int threads)
+	: m_decode(std::move(decode))
+{
+	for (int i = 0; i < threads; ++i)
+		m_threads.emplace_back(&Graphic_Loader::worker_main, this);
+}
+
+Graphic_Loader::~Graphic_Loader()
+{
+	{
+		std::unique_lock lock(m_mutex);
+		m_stopping = true;
+	}
+
+	m_cv.notify_all();
+
+	for (auto&& thread : m_threads)
+		thread.join();
+}
+
+void Graphic_Loader::worker_main()
+{
+	std::unique_lock lock(m_mutex);
+
+	while (true)
+	{
+		m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+
+		if (m_stopping)
+			break;
+
+		Image image;
+		image.key = m_queue.front();
+		m_queue.pop_front();
+		m_working.insert(image.key);
+
+		lock.unlock();
+
+		if (!m_decode(image.key, image))
+			image.pixels.clear();
+
+		lock.lock();
+
+		if (image.pixels.empty())
+			++m_stats.failed;
+		else
+			++m_stats.decoded;
+
+		m_working.erase(image.key);
+		m_finished.push_back(std::move(image));
+
+		m_finished_cv.notify_all();
+	}
+}
+
+void Graphic_Loader::request(std::uint64_t key)
+{
+	if (m_threads.empty())
+		return;
+
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (!m_known.insert(key).second)
+			return;
+
+		m_queue.push_back(key);
+		++m_stats.requested;
+	}
+
+	m_cv.notify_one();
+}
+
+void Graphic_Loader::clear_requests()
+{
+	std::unique_lock lock(m_mutex);
+
+	for (auto key : m_queue)
+		m_known.erase(key);
+
+	m_queue.clear();
+}
+
+bool Graphic_Loader::take(std::uint64_t key, Image& image)
+{
+	std::unique_lock lock(m_mutex);
+
+	if (m_known.find(key) == m_known.end())
+		return false;
+
+	auto queued = std::find(m_queue.begin(), m_queue.end(), key);
+
+	// Decoding it here is no slower than waiting for a worker to get to it
+	if (queued != m_queue.end())
+	{
+		m_queue.erase(queued);
+		m_known.erase(key);
+		return false;
+	}
+
+	m_finished_cv.wait(lock, [this, key] { return m_working.find(key) == m_working.end(); });
+
+	auto finished = std::find_if(m_finished.begin(), m_finished.end(),
+		[key](const Image& image) { return image.key == key; });
+
+	if (finished == m_finished.end())
+		return false;
+
+	image = std::move(*finished);
+	m_finished.erase(finished);
+	m_known.erase(key);
+	++m_stats.taken;
+
+	return true;
+}
+
+void Graphic_Loader::collect(std::vector<Image>& out, std::size_t max_bytes)
+{
+	std::unique_lock lock(m_mutex);
+
+	std::size_t bytes = 0;
+	auto it = m_finished.begin();
+
+	for (; it != m_finished.end() && (bytes < max_bytes || it == m_finished.begin()); ++it)
+	{
+		bytes += it->pixels.size();
+		m_known.erase(it->key);
+		out.push_back(std::move(*it));
+	}
+
+	m_finished.erase(m_finished.begin(), it);
+}
+
+Graphic_Loader::Stats Graphic_Loader::stats()
+{
+	std::unique_lock lock(m_mutex);
+
+	Stats result = m_stats;
+	result.queued = m_queue.size();
+	result.finished = m_finished.size();
+
+	for (auto&& image : m_finished)
+		result.finished_bytes += image.pixels.size();
+
+	return result;
+}
+
+std::vector<std::pair<std::uint64_t, std::size_t>> Graphic_Loader::finished_sizes()
+{
+	std::unique_lock lock(m_mutex);
+
+	std::vector<std::pair<std::uint64_t, std::size_t>> result;
+	result.reserve(m_finished.size());
+
+	for (auto&& image : m_finished)
+		result.emplace_back(image.key, image.pixels.size());
+
+	return result;
+}
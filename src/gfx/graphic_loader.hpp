@@ -0,0 +1,103 @@
+#ifndef EO_GRAPHIC_LOADER_HPP
+#define EO_GRAPHIC_LOADER_HPP
+
+#include "gfx/pixel_format.hpp"
+#include "util/function.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Decodes graphics to RGBA on a pool of worker threads, ahead of them being drawn
+// Only the upload of a finished image is left to the main thread
+// Requests are taken in the order they're made, so the most wanted should come first
+// All member functions are called from the main thread, the decode function from the workers
+
+class Graphic_Loader
+{
+	public:
+		struct Image
+		{
+			std::uint64_t key = 0;
+			int width = 0;
+			int height = 0;
+
+			// 4 bytes per pixel, empty if the graphic couldn't be decoded
+			std::vector<char> pixels;
+			Pixel_Format format = Pixel_Format::rgba;
+		};
+
+		struct Stats
+		{
+			std::uint64_t requested = 0;
+			std::uint64_t decoded = 0;
+			std::uint64_t failed = 0;
+
+			// Requested graphics which were needed before they'd been collected
+			std::uint64_t taken = 0;
+
+			std::size_t queued = 0;
+			std::size_t finished = 0;
+
+			// Pixels of the finished images
+			std::size_t finished_bytes = 0;
+		};
+
+		// Must be safe to call from several threads at once
+		using decode_fn = util::function<bool(std::uint64_t key, Image& image)>;
+
+	private:
+		decode_fn m_decode;
+		std::vector<std::thread> m_threads;
+
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::condition_variable m_finished_cv;
+
+		std::deque<std::uint64_t> m_queue;
+		std::unordered_set<std::uint64_t> m_working;
+		std::vector<Image> m_finished;
+
+		// Every key queued, being decoded or finished but not yet collected
+		std::unordered_set<std::uint64_t> m_known;
+
+		bool m_stopping = false;
+		Stats m_stats;
+
+		void worker_main();
+
+	public:
+		Graphic_Loader(decode_fn decode, int threads);
+		~Graphic_Loader();
+
+		// no copy/move/assign
+		Graphic_Loader(const Graphic_Loader&) = delete;
+		const Graphic_Loader& operator=(const Graphic_Loader&) = delete;
+
+		// Does nothing if the key has already been requested
+		void request(std::uint64_t key);
+
+		// Forgets requests which haven't been started, eg. after moving somewhere else
+		void clear_requests();
+
+		// Hands over a requested image for immediate use, waiting for it if it's being decoded
+		// Returns false if it's not been requested or not yet started, the request is dropped
+		bool take(std::uint64_t key, Image& image);
+
+		// Moves finished images to out, stopping once max_bytes of pixels have been moved
+		// At least one image is moved if any are finished
+		void collect(std::vector<Image>& out, std::size_t max_bytes);
+
+		Stats stats();
+
+		// Key and pixel bytes of each finished image
+		std::vector<std::pair<std::uint64_t, std::size_t>> finished_sizes();
+};
+
+#endif // EO_GRAPHIC_LOADER_HPP
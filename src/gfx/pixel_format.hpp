@@ -0,0 +1,13 @@
+#ifndef EO_GFX_PIXEL_FORMAT_HPP
+#define EO_GFX_PIXEL_FORMAT_HPP
+
+#include <cstdint>
+
+// Byte order of 32-bit pixels in memory
+enum class Pixel_Format : std::uint32_t
+{
+	rgba = 1,
+	bgra = 2
+};
+
+#endif // EO_GFX_PIXEL_FORMAT_HPP
@@ -0,0 +1,264 @@
+#include "login_sequence.hpp"
+
+#include "net_download.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <random>
+
+#define TRACE_CTX "login"
+
+Login_Sequence::Login_Sequence(NetClient& client, std::shared_ptr<Net_Download> download,
+                               Options options)
+	: m_client(client)
+	, m_download(std::move(download))
+	, m_options(std::move(options))
+{
+	if (m_download)
+		m_client.set_file_sink(m_download);
+}
+
+void Login_Sequence::start(const std::string& host, const std::string& port)
+{
+	m_stage = handshake;
+	m_start = clock::now();
+	m_timings = {};
+	m_entered = false;
+	m_pending_files.clear();
+	m_map = nullptr;
+
+	m_client.connect(host, port);
+}
+
+void Login_Sequence::fail(const char* reason)
+{
+	if (m_stage == failed || m_stage == complete)
+		return;
+
+	trace_log("login failed: " << reason);
+
+	m_stage = failed;
+	sig_failed(reason);
+
+	m_client.disconnect();
+}
+
+void Login_Sequence::handle_state(NetClient::state_t state)
+{
+	if (m_stage == idle || m_stage == complete || m_stage == failed)
+		return;
+
+	switch (state)
+	{
+		case NetClient::connected:
+		{
+			cli::Init_Init init;
+			init.challenge = eo_three(std::random_device{}() % 11092110 + 1);
+			init.version = m_options.version;
+			init.hdid = m_options.hdid;
+			m_client.send_packet(init);
+			break;
+		}
+
+		case NetClient::ready:
+		{
+			m_timings.handshake = clock::now() - m_start;
+			m_stage = login;
+
+			// The server answers Connection_Accept with nothing, so there is no reason to wait
+			cli::Connection_Accept accept;
+			m_client.send_packet(accept);
+
+			cli::Login_Request request;
+			request.username = m_options.username;
+			request.password = m_options.password;
+			m_client.send_packet(request);
+			break;
+		}
+
+		case NetClient::disconnected:
+			fail("disconnected");
+			break;
+
+		default:
+			break;
+	}
+}
+
+void Login_Sequence::handle_packet(const Server_Packet& packet)
+{
+	auto id = packet.vid();
+
+	if (id == srv::Init_Init::id)
+	{
+		auto&& init = packet.as<srv::Init_Init>();
+
+		if (m_stage == handshake)
+		{
+			if (init.reply_code == InitReply::Out_Of_Date)
+				fail("client version out of date");
+			else if (init.reply_code == InitReply::Banned)
+				fail("banned");
+
+			return;
+		}
+
+		if (m_stage != enter)
+			return;
+
+		// Replies small enough to skip streaming arrive with their content
+		const std::string* content = nullptr;
+		int file_id = 1;
+
+		switch (init.reply_code)
+		{
+			case InitReply::File_Map: content = &init.u.file_map.content; break;
+			case InitReply::File_EIF: content = &init.u.file_eif.content; file_id = init.u.file_eif.file_id; break;
+			case InitReply::File_ENF: content = &init.u.file_enf.content; file_id = init.u.file_enf.file_id; break;
+			case InitReply::File_ESF: content = &init.u.file_esf.content; file_id = init.u.file_esf.file_id; break;
+			case InitReply::File_ECF: content = &init.u.file_ecf.content; file_id = init.u.file_ecf.file_id; break;
+			default: return;
+		}
+
+		if (m_download && !content->empty())
+			m_download->store(init.reply_code, file_id, *content);
+
+		handle_file(init.reply_code);
+	}
+	else if (id == srv::Login_Reply::id && m_stage == login)
+	{
+		auto&& reply = packet.as<srv::Login_Reply>();
+
+		m_timings.login = clock::now() - m_start;
+
+		if (reply.reply_code != LoginReply::OK)
+		{
+			fail("login rejected");
+			return;
+		}
+
+		auto&& characters = reply.u.ok.character_list.characters;
+
+		auto it = std::find_if(characters.begin(), characters.end(),
+			[this](const Character_Info& character)
+			{
+				return m_options.character.empty() || character.name == m_options.character;
+			});
+
+		if (it == characters.end())
+		{
+			fail("character not found");
+			return;
+		}
+
+		m_character_id = it->id;
+		m_stage = select;
+
+		cli::Welcome_Request request;
+		request.character_id = m_character_id;
+		m_client.send_packet(request);
+	}
+	else if (id == srv::Welcome_Reply::id)
+	{
+		auto&& reply = packet.as<srv::Welcome_Reply>();
+
+		if (m_stage == select && reply.welcome_code == WelcomeCode::SelectCharacter)
+		{
+			m_timings.select = clock::now() - m_start;
+			m_player_id = reply.u.select_character.player_Id;
+			m_map_id = reply.u.select_character.map_id;
+			m_stage = enter;
+
+			request_files(reply);
+
+			// File replies come back ahead of the Welcome_Reply this produces
+			cli::Welcome_Msg msg;
+			msg.character_id = m_character_id;
+			m_client.send_packet(msg);
+		}
+		else if (m_stage == enter && reply.welcome_code == WelcomeCode::EnterGame)
+		{
+			m_timings.enter = clock::now() - m_start;
+			m_entered = true;
+			check_complete();
+		}
+	}
+}
+
+void Login_Sequence::request_files(const srv::Welcome_Reply& reply)
+{
+	m_timings.files = m_timings.select;
+
+	if (!m_download)
+		return;
+
+	auto&& select = reply.u.select_character;
+
+	struct file_t
+	{
+		FileType file_type;
+		InitReply reply_type;
+		int id;
+		const std::array<eo_byte, 4>& hash;
+		std::size_t size;
+	};
+
+	const file_t files[] = {
+		{FileType::Map,   InitReply::File_Map, m_map_id, select.map_hash, std::size_t(select.map_filename)},
+		{FileType::Item,  InitReply::File_EIF, 1,        select.eif_hash, 0},
+		{FileType::NPC,   InitReply::File_ENF, 1,        select.enf_hash, 0},
+		{FileType::Spell, InitReply::File_ESF, 1,        select.esf_hash, 0},
+		{FileType::Class, InitReply::File_ECF, 1,        select.ecf_hash, 0}
+	};
+
+	m_download->set_map_id(m_map_id);
+
+	for (auto&& file : files)
+	{
+		if (m_download->cached(file.reply_type, file.id, file.hash, file.size))
+			continue;
+
+		trace_log("requesting " << Net_Download::cache_path(file.reply_type, file.id));
+
+		cli::Welcome_Agree request;
+		request.file_type = file.file_type;
+		m_client.send_packet(request);
+
+		m_pending_files.push_back(file.reply_type);
+	}
+}
+
+void Login_Sequence::handle_file(InitReply type)
+{
+	auto it = std::find(m_pending_files.begin(), m_pending_files.end(), type);
+
+	if (it == m_pending_files.end())
+		return;
+
+	m_pending_files.erase(it);
+
+	if (type == InitReply::File_Map)
+		m_map = m_download->take_map();
+
+	if (m_pending_files.empty())
+		m_timings.files = clock::now() - m_start;
+
+	check_complete();
+}
+
+void Login_Sequence::check_complete()
+{
+	if (!m_entered || !m_pending_files.empty())
+		return;
+
+	// The map was already up to date
+	if (m_download && !m_map)
+		m_map = m_download->load_map(m_map_id);
+
+	m_stage = complete;
+
+	trace_log("in game after " << std::chrono::duration_cast<std::chrono::milliseconds>(m_timings.enter).count() << "ms");
+
+	sig_complete();
+}
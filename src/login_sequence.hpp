@@ -0,0 +1,109 @@
+#ifndef EO_LOGIN_SEQUENCE_HPP
+#define EO_LOGIN_SEQUENCE_HPP
+
+#include "netclient.hpp"
+#include "packet/eo_packets.hpp"
+
+#include "util/signal.hpp"
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+
+struct Full_EMF;
+class Net_Download;
+
+// Drives a NetClient from connection to entering the game
+// Requests which don't depend on each other's replies are sent back to back:
+//   Connection_Accept with Login_Request, and every missing file with Welcome_Msg
+// The owner forwards NetClient's signals to handle_state() and handle_packet()
+// Only Init_Init, Login_Reply and Welcome_Reply packets are needed
+
+class Login_Sequence
+{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		enum stage_t
+		{
+			idle,
+			handshake,
+			login,
+			select,
+			enter,
+			complete,
+			failed
+		};
+
+		struct Options
+		{
+			std::string username;
+			std::string password;
+
+			// Character to play, empty selects the first one
+			std::string character;
+
+			std::array<eo_char, 3> version = {0, 0, 28};
+			std::string hdid = "eoref";
+		};
+
+		// Time each stage completed, relative to start()
+		struct Timings
+		{
+			clock::duration handshake{};
+			clock::duration login{};
+			clock::duration select{};
+			clock::duration files{};
+			clock::duration enter{};
+		};
+
+		util::signal<void()> sig_complete;
+		util::signal<void(const char* reason)> sig_failed;
+
+	private:
+		NetClient& m_client;
+		std::shared_ptr<Net_Download> m_download;
+		Options m_options;
+
+		stage_t m_stage = idle;
+		clock::time_point m_start;
+		Timings m_timings;
+
+		int m_player_id = 0;
+		int m_character_id = 0;
+		int m_map_id = 0;
+		bool m_entered = false;
+
+		// File replies still expected, in request order
+		std::deque<InitReply> m_pending_files;
+		std::shared_ptr<Full_EMF> m_map;
+
+		void fail(const char* reason);
+		void request_files(const srv::Welcome_Reply& reply);
+		void handle_file(InitReply type);
+		void check_complete();
+
+	public:
+		// Without a downloader no files are requested and map() stays null
+		Login_Sequence(NetClient& client, std::shared_ptr<Net_Download> download, Options options);
+
+		// Connects and runs the sequence
+		void start(const std::string& host, const std::string& port);
+
+		void handle_state(NetClient::state_t state);
+		void handle_packet(const Server_Packet& packet);
+
+		stage_t stage() const { return m_stage; }
+		const Timings& timings() const { return m_timings; }
+
+		int player_id() const { return m_player_id; }
+		int character_id() const { return m_character_id; }
+		int map_id() const { return m_map_id; }
+
+		// The current map, from the download or the cache
+		std::shared_ptr<Full_EMF> map() const { return m_map; }
+};
+
+#endif // EO_LOGIN_SEQUENCE_HPP
@@ -0,0 +1,200 @@
+#include "net_capture.hpp"
+
+#include "trace.hpp"
+
+#include <cstring>
+#include <utility>
+
+#define TRACE_CTX "net_capture"
+
+static void append_u32_le(std::vector<char>& buf, std::uint32_t n)
+{
+	for (int i = 0; i < 4; ++i)
+		buf.push_back(char((n >> (i * 8)) & 0xFF));
+}
+
+static void append_u64_le(std::vector<char>& buf, std::uint64_t n)
+{
+	for (int i = 0; i < 8; ++i)
+		buf.push_back(char((n >> (i * 8)) & 0xFF));
+}
+
+static std::uint64_t read_le(const char* p, int n)
+{
+	std::uint64_t result = 0;
+
+	for (int i = 0; i < n; ++i)
+		result |= std::uint64_t(std::uint8_t(p[i])) << (i * 8);
+
+	return result;
+}
+
+bool Net_Capture::parse(std::string_view data, std::vector<Record>& records)
+{
+	if (data.size() < header_size
+	 || data.substr(0, sizeof magic) != std::string_view(magic, sizeof magic)
+	 || read_le(&data[4], 4) != version)
+		return false;
+
+	std::size_t pos = header_size;
+
+	while (data.size() - pos >= record_header_size)
+	{
+		const char* p = &data[pos];
+
+		auto type = record_t(std::uint8_t(p[0]));
+		auto time_ns = read_le(p + 1, 8);
+		auto length = std::size_t(read_le(p + 9, 4));
+
+		pos += record_header_size;
+
+		if (data.size() - pos < length)
+			break;
+
+		records.push_back({type, time_ns, data.substr(pos, length)});
+		pos += length;
+	}
+
+	return true;
+}
+
+Net_Capture::~Net_Capture()
+{
+	stop();
+}
+
+bool Net_Capture::start(const std::string& filename)
+{
+	stop();
+
+	if (!m_file.open(filename.c_str(), cio::stream::mode_write))
+	{
+		trace_log("could not open " << filename);
+		return false;
+	}
+
+	std::vector<char> header(std::begin(magic), std::end(magic));
+	append_u32_le(header, version);
+	if (m_file.write(header.data(), header.size()) != header.size())
+	{
+		trace_log("could not write " << filename);
+		m_file.close();
+		return false;
+	}
+
+	m_pending.clear();
+	m_stopping = false;
+	m_thread = std::thread(&Net_Capture::writer_main, this);
+	m_active = true;
+
+	trace_log("capturing to " << filename);
+
+	return true;
+}
+
+void Net_Capture::stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_active = false;
+
+	{
+		std::unique_lock lock(m_mutex);
+		m_stopping = true;
+	}
+
+	m_cv.notify_one();
+	m_thread.join();
+
+	m_file.close();
+}
+
+void Net_Capture::writer_main()
+{
+	std::vector<char> buf;
+
+	std::unique_lock lock(m_mutex);
+
+	while (true)
+	{
+		m_cv.wait(lock, [this] { return m_stopping || !m_pending.empty(); });
+
+		bool stopping = m_stopping;
+		std::swap(buf, m_pending);
+
+		lock.unlock();
+
+		if (!buf.empty())
+		{
+			bool ok = m_file.write(buf.data(), buf.size()) == buf.size() && m_file;
+			buf.clear();
+
+			// Keeping on after a failed write would leave a corrupt capture
+			if (!ok)
+			{
+				trace_log("write failed, capture stopped");
+				m_active = false;
+
+				lock.lock();
+				m_stopping = true;
+				m_pending.clear();
+				return;
+			}
+		}
+
+		if (stopping)
+			break;
+
+		lock.lock();
+	}
+
+	m_file.flush();
+}
+
+void Net_Capture::record(record_t type, std::initializer_list<std::string_view> parts,
+                         clock::time_point time)
+{
+	if (!active())
+		return;
+
+	std::size_t length = 0;
+
+	for (auto part : parts)
+		length += part.size();
+
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch());
+
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (m_stopping)
+			return;
+
+		m_pending.push_back(char(type));
+		append_u64_le(m_pending, std::uint64_t(ns.count()));
+		append_u32_le(m_pending, std::uint32_t(length));
+
+		for (auto part : parts)
+			m_pending.insert(m_pending.end(), part.begin(), part.end());
+	}
+
+	m_cv.notify_one();
+}
+
+void Net_Capture::record_multi(std::uint8_t multi_d, std::uint8_t multi_e)
+{
+	const char payload[2] = {char(multi_d), char(multi_e)};
+
+	record(multi_change, {std::string_view(payload, sizeof payload)});
+}
+
+void Net_Capture::record_seq(std::uint32_t seq_start)
+{
+	const char payload[4] = {
+		char(seq_start & 0xFF), char((seq_start >> 8) & 0xFF),
+		char((seq_start >> 16) & 0xFF), char((seq_start >> 24) & 0xFF)
+	};
+
+	record(seq_change, {std::string_view(payload, sizeof payload)});
+}
@@ -0,0 +1,99 @@
+#ifndef EO_NET_CAPTURE_HPP
+#define EO_NET_CAPTURE_HPP
+
+#include "cio/cio.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Session capture file written from the NetClient boundary
+//
+// File layout (all integers little-endian):
+//   header: "EOCP" u32 version
+//   record: u8 type, u64 timestamp (steady_clock, ns), u32 length, payload
+//
+// Frames are stored as they appear on the wire, including the two byte
+// length prefix. Multiplier and sequence changes are stored alongside so
+// that a capture can be decoded without replaying the handshake.
+
+class Net_Capture
+{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		static constexpr char magic[4] = {'E', 'O', 'C', 'P'};
+		static constexpr std::uint32_t version = 1;
+
+		static constexpr std::size_t header_size = 8;
+		static constexpr std::size_t record_header_size = 13;
+
+		enum record_t : std::uint8_t
+		{
+			// Raw encrypted frame from the server
+			frame_in = 1,
+			// Raw encrypted frame sent to the server
+			frame_out = 2,
+			// Payload: u8 multi_d, u8 multi_e
+			multi_change = 3,
+			// Payload: u32 seq_start
+			seq_change = 4
+		};
+
+		struct Record
+		{
+			record_t type;
+			std::uint64_t time_ns;
+			std::string_view payload;
+		};
+
+		// Splits a capture file held in memory in to records
+		// A truncated final record is ignored, returns false if the header is invalid
+		static bool parse(std::string_view data, std::vector<Record>& records);
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::thread m_thread;
+
+		// Records are appended here by the I/O thread and swapped out by the writer
+		std::vector<char> m_pending;
+		bool m_stopping = false;
+
+		std::atomic<bool> m_active = false;
+		cio::stream m_file{static_cast<std::FILE*>(nullptr)};
+
+		void writer_main();
+
+	public:
+		Net_Capture() = default;
+		~Net_Capture();
+
+		// no copy/move/assign
+		Net_Capture(const Net_Capture&) = delete;
+		const Net_Capture& operator=(const Net_Capture&) = delete;
+
+		bool start(const std::string& filename);
+		void stop();
+
+		bool active() const
+		{
+			return m_active.load(std::memory_order_relaxed);
+		}
+
+		// Parts are concatenated into a single record payload
+		void record(record_t type, std::initializer_list<std::string_view> parts,
+		            clock::time_point time = clock::now());
+
+		void record_multi(std::uint8_t multi_d, std::uint8_t multi_e);
+		void record_seq(std::uint32_t seq_start);
+};
+
+#endif // EO_NET_CAPTURE_HPP
@@ -0,0 +1,94 @@
+#include "net_coalescer.hpp"
+
+#include "packet/eo_packets.hpp"
+
+template <class T>
+static std::uint32_t player_id_key(const Server_Packet& packet)
+{
+	return packet.as<T>().player_id;
+}
+
+Net_Coalescer::Net_Coalescer()
+{
+	// Walk_Player carries absolute coordinates, so only the newest step of each player matters
+	set_rule(srv::Walk_Player::id, {true, player_id_key<srv::Walk_Player>, {}});
+
+	// Recover_Player carries the full HP/TP values
+	set_rule(srv::Recover_Player::id, {true, nullptr, {}});
+
+	// Refresh_Reply resends everything nearby, so earlier changes to it can be skipped
+	set_rule(srv::Refresh_Reply::id, {false, nullptr, {
+		srv::Refresh_Reply::id,
+		srv::Players_Agree::id,
+		srv::Avatar_Remove::id,
+		srv::Walk_Player::id,
+		srv::Sit_Player::id,
+		srv::Item_Add::id
+	}});
+}
+
+void Net_Coalescer::set_rule(PacketID id, Rule rule)
+{
+	m_rules[packet_id_hash(id)] = std::move(rule);
+}
+
+void Net_Coalescer::clear_rule(PacketID id)
+{
+	m_rules.erase(packet_id_hash(id));
+}
+
+void Net_Coalescer::clear_rules()
+{
+	m_rules.clear();
+}
+
+std::size_t Net_Coalescer::coalesce(std::vector<Entry>& queue)
+{
+	if (queue.size() < 2 || m_rules.empty())
+		return 0;
+
+	std::size_t count = 0;
+
+	m_seen.clear();
+	m_replaced.clear();
+
+	// Newest first, so each packet only needs to know what follows it
+	for (auto it = queue.rbegin(); it != queue.rend(); ++it)
+	{
+		if (it->superseded)
+			continue;
+
+		unsigned id = packet_id_hash(it->packet->vid());
+
+		if (m_replaced.count(id))
+		{
+			it->superseded = true;
+			++count;
+			continue;
+		}
+
+		auto rule_it = m_rules.find(id);
+
+		if (rule_it == m_rules.end())
+			continue;
+
+		auto&& rule = rule_it->second;
+
+		if (rule.latest)
+		{
+			std::uint32_t key = rule.key ? rule.key(*it->packet) : 0;
+
+			if (!m_seen.insert((std::uint64_t(id) << 32) | key).second)
+			{
+				it->superseded = true;
+				++count;
+				continue;
+			}
+		}
+
+		for (auto&& replaced_id : rule.replaces)
+			m_replaced.insert(packet_id_hash(replaced_id));
+	}
+
+	return count;
+}
@@ -0,0 +1,61 @@
+#ifndef EO_NET_COALESCER_HPP
+#define EO_NET_COALESCER_HPP
+
+#include "net_telemetry.hpp"
+#include "packet/packet_base.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Drops queued incoming packets which are superseded by a later packet in the same queue
+// Only does work when more than one packet is waiting, ie. the game thread has fallen behind
+
+class Net_Coalescer
+{
+	public:
+		// Identifies the subject of a packet, eg. a player_id
+		using key_func = std::uint32_t (*)(const Server_Packet&);
+
+		struct Rule
+		{
+			// Only the newest packet of this type is kept (per key, if one is given)
+			bool latest = false;
+			key_func key = nullptr;
+
+			// Packet types queued before this one which it makes obsolete
+			std::vector<PacketID> replaces;
+		};
+
+		struct Entry
+		{
+			std::shared_ptr<Server_Packet> packet;
+			std::size_t frame_size = 0;
+			Net_Telemetry::clock::duration decode_time{};
+			bool superseded = false;
+		};
+
+	private:
+		std::unordered_map<unsigned, Rule> m_rules;
+
+		// Members so the bucket arrays survive between calls, inserts still allocate a node each
+		std::unordered_set<std::uint64_t> m_seen;
+		std::unordered_set<unsigned> m_replaced;
+
+	public:
+		// Installs the default rules, see net_coalescer.cpp
+		Net_Coalescer();
+
+		void set_rule(PacketID id, Rule rule);
+		void clear_rule(PacketID id);
+		void clear_rules();
+
+		// Marks superseded entries, the order of the remaining entries is unchanged
+		// Returns the number of entries marked
+		std::size_t coalesce(std::vector<Entry>& queue);
+};
+
+#endif // EO_NET_COALESCER_HPP
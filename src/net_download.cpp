@@ -0,0 +1,181 @@
+#include "net_download.hpp"
+
+#include "trace.hpp"
+
+#include <cstdio>
+
+#define TRACE_CTX "download"
+
+Net_Download::Net_Download(std::string data_dir)
+	: m_data_dir(std::move(data_dir))
+{ }
+
+void Net_Download::set_map_id(int map_id)
+{
+	m_map_id = map_id;
+}
+
+std::string Net_Download::cache_path(InitReply type, int id)
+{
+	const char* format = nullptr;
+
+	switch (type)
+	{
+		case InitReply::File_Map: format = "maps/%05d.emf"; break;
+		case InitReply::File_EIF: format = "pub/dat%03d.eif"; break;
+		case InitReply::File_ENF: format = "pub/dtn%03d.enf"; break;
+		case InitReply::File_ESF: format = "pub/dsl%03d.esf"; break;
+		case InitReply::File_ECF: format = "pub/dat%03d.ecf"; break;
+		default: return {};
+	}
+
+	char buf[32];
+	std::snprintf(buf, sizeof buf, format, id);
+	return buf;
+}
+
+bool Net_Download::cached(InitReply type, int id, const std::array<eo_byte, 4>& hash,
+                          std::size_t size) const
+{
+	std::string path = cache_path(type, id);
+
+	if (path.empty())
+		return false;
+
+	path = m_data_dir + "/" + path;
+	cio::stream file(path.c_str(), cio::stream::mode_read);
+
+	if (!file)
+		return false;
+
+	// Every map and pub format has the hash right after its 3 byte magic number
+	char header[7];
+
+	if (file.read(header, sizeof header) != sizeof header)
+		return false;
+
+	for (std::size_t i = 0; i < hash.size(); ++i)
+	{
+		if (eo_byte(header[3 + i]) != hash[i])
+			return false;
+	}
+
+	if (size != 0)
+	{
+		std::size_t file_size = sizeof header;
+		char buf[4096];
+		std::size_t n;
+
+		while ((n = file.read(buf, sizeof buf)) > 0)
+			file_size += n;
+
+		if (file_size != size)
+			return false;
+	}
+
+	return true;
+}
+
+std::shared_ptr<Full_EMF> Net_Download::load_map(int map_id) const
+{
+	std::string path = m_data_dir + "/" + cache_path(InitReply::File_Map, map_id);
+	cio::stream file(path.c_str(), cio::stream::mode_read);
+
+	if (!file)
+		return nullptr;
+
+	auto map = std::make_shared<Full_EMF>();
+	Full_EMF_Parser parser(*map);
+	char buf[4096];
+	std::size_t n;
+
+	while ((n = file.read(buf, sizeof buf)) > 0)
+	{
+		if (!parser.feed({buf, n}))
+			return nullptr;
+	}
+
+	return parser.finish() ? map : nullptr;
+}
+
+void Net_Download::store(InitReply type, int file_id, std::string_view content)
+{
+	if (!begin(type, file_id, content.size()))
+		return;
+
+	data(content);
+	end(true);
+}
+
+std::shared_ptr<Full_EMF> Net_Download::take_map()
+{
+	return std::move(m_completed_map);
+}
+
+bool Net_Download::begin(InitReply type, int file_id, std::size_t size)
+{
+	int id = (type == InitReply::File_Map) ? m_map_id : file_id;
+	std::string path = cache_path(type, id);
+
+	if (path.empty())
+		return false;
+
+	m_type = type;
+	m_path = m_data_dir + "/" + path;
+	m_part_path = m_path + ".part";
+	m_write_failed = false;
+
+	if (!m_file.open(m_part_path.c_str(), cio::stream::mode_write))
+	{
+		trace_log("could not open " << m_part_path);
+		m_write_failed = true;
+	}
+
+	if (type == InitReply::File_Map)
+	{
+		m_map = std::make_shared<Full_EMF>();
+		m_map_parser.emplace(*m_map);
+	}
+
+	trace_log("receiving " << path << " (" << size << " bytes)");
+
+	return true;
+}
+
+void Net_Download::data(std::string_view chunk)
+{
+	if (!m_write_failed)
+		m_write_failed = (m_file.write(chunk.data(), chunk.size()) != chunk.size());
+
+	if (m_map_parser && !m_map_parser->feed(chunk))
+	{
+		trace_log("map data is malformed");
+		m_map_parser.reset();
+	}
+}
+
+void Net_Download::end(bool complete)
+{
+	m_file.close();
+
+	if (complete && !m_write_failed)
+	{
+#ifdef _WIN32
+		// rename() won't replace an existing file here, elsewhere it replaces it atomically
+		std::remove(m_path.c_str());
+#endif // _WIN32
+
+		if (std::rename(m_part_path.c_str(), m_path.c_str()) != 0)
+			trace_log("could not move " << m_part_path << " in to place");
+	}
+	else
+	{
+		std::remove(m_part_path.c_str());
+	}
+
+	if (complete && m_map_parser && m_map_parser->finish())
+		m_completed_map = std::move(m_map);
+
+	m_map_parser.reset();
+	m_map.reset();
+}
@@ -0,0 +1,77 @@
+#ifndef EO_NET_DOWNLOAD_HPP
+#define EO_NET_DOWNLOAD_HPP
+
+#include "data/full_emf.hpp"
+#include "packet/eo_packets.hpp"
+
+#include "cio/cio.hpp"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Receives the content of Init_Init file replies as it arrives from the socket
+// Called from the NetClient's network handlers
+class Net_File_Sink
+{
+	public:
+		virtual ~Net_File_Sink() = default;
+
+		// Return false to have the reply delivered as a normal packet instead
+		virtual bool begin(InitReply type, int file_id, std::size_t size) = 0;
+
+		virtual void data(std::string_view chunk) = 0;
+
+		// complete is false if the connection was lost part way through
+		virtual void end(bool complete) = 0;
+};
+
+// Writes map and pub files to the on-disk cache, parsing maps as they arrive
+// Files are written under a temporary name and moved in to place once complete
+class Net_Download : public Net_File_Sink
+{
+	private:
+		std::string m_data_dir;
+		int m_map_id = 0;
+
+		InitReply m_type;
+		std::string m_path;
+		std::string m_part_path;
+		cio::stream m_file{static_cast<std::FILE*>(nullptr)};
+		bool m_write_failed = false;
+
+		std::shared_ptr<Full_EMF> m_map;
+		std::optional<Full_EMF_Parser> m_map_parser;
+		std::shared_ptr<Full_EMF> m_completed_map;
+
+	public:
+		explicit Net_Download(std::string data_dir = ".");
+
+		// File_Map replies don't say which map they contain
+		void set_map_id(int map_id);
+
+		// Location of a cached file relative to the data directory, empty for non-file replies
+		static std::string cache_path(InitReply type, int id);
+
+		// True if the cached file starts with the given hash, and has the given size if non-zero
+		bool cached(InitReply type, int id, const std::array<eo_byte, 4>& hash,
+		            std::size_t size = 0) const;
+
+		// Parses a map from the cache, null if missing or malformed
+		std::shared_ptr<Full_EMF> load_map(int map_id) const;
+
+		// Handles a reply which was delivered whole rather than streamed
+		void store(InitReply type, int file_id, std::string_view content);
+
+		// The most recently completed map, parsed while it downloaded
+		std::shared_ptr<Full_EMF> take_map();
+
+		bool begin(InitReply type, int file_id, std::size_t size) override;
+		void data(std::string_view chunk) override;
+		void end(bool complete) override;
+};
+
+#endif // EO_NET_DOWNLOAD_HPP
@@ -0,0 +1,260 @@
+#include "net_send_filter.hpp"
+
+#include "data/eo_stream.hpp"
+#include "packet/eo_packets.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+// Copies the packet types which carry a timestamp, nullptr for any other
+static std::unique_ptr<Client_Packet> copy_timed(const Client_Packet& packet)
+{
+	auto id = packet.vid();
+
+	if (id == cli::Walk_Player::id)
+		return std::make_unique<cli::Walk_Player>(packet.as<cli::Walk_Player>());
+	else if (id == cli::Walk_Admin::id)
+		return std::make_unique<cli::Walk_Admin>(packet.as<cli::Walk_Admin>());
+	else if (id == cli::Walk_Spec::id)
+		return std::make_unique<cli::Walk_Spec>(packet.as<cli::Walk_Spec>());
+	else if (id == cli::Attack_Use::id)
+		return std::make_unique<cli::Attack_Use>(packet.as<cli::Attack_Use>());
+
+	return nullptr;
+}
+
+// Timestamps count centiseconds, and must still be in order with ones sent while this was held
+static void advance_timestamp(Client_Packet& packet, Net_Send_Filter::clock::duration held_for)
+{
+	constexpr unsigned timestamp_max = 253U * 253U * 253U;
+
+	unsigned centiseconds = unsigned(std::chrono::duration_cast<std::chrono::milliseconds>(held_for).count() / 10);
+
+	auto advance = [centiseconds](eo_three& timestamp)
+	{
+		timestamp = eo_three((unsigned(timestamp) + centiseconds) % timestamp_max);
+	};
+
+	auto id = packet.vid();
+
+	if (id == cli::Walk_Player::id)
+		advance(packet.as<cli::Walk_Player>().walk.timestamp);
+	else if (id == cli::Walk_Admin::id)
+		advance(packet.as<cli::Walk_Admin>().walk.timestamp);
+	else if (id == cli::Walk_Spec::id)
+		advance(packet.as<cli::Walk_Spec>().walk.timestamp);
+	else if (id == cli::Attack_Use::id)
+		advance(packet.as<cli::Attack_Use>().timestamp);
+}
+
+void Net_Send_Filter::Packet::serialize(const Client_Packet& packet)
+{
+	auto serialize_start = clock::now();
+
+	EO_Stream_Builder builder(packet.byte_size());
+	packet.serialize(builder);
+	body = std::move(builder.get());
+
+	serialize_time = clock::now() - serialize_start;
+}
+
+Net_Send_Filter::Net_Send_Filter()
+{
+	// Intervals are about the rate the server processes each action at
+	// Anything faster only sits in the server's queue, or gets the client kicked
+
+	// Walk_Player also sets the direction faced
+	set_rule(cli::Walk_Player::id, {460ms, false, {cli::Face_Player::id}, 2});
+
+	// Only the last of a burst of turns matters
+	set_rule(cli::Face_Player::id, {120ms, true, {}, 1});
+
+	set_rule(cli::Attack_Use::id, {580ms, false, {cli::Face_Player::id}, 1});
+
+	// Keep-alives, latency probes and player lookups would only be delayed by waiting
+	// Everything else, such as Door_Open, Item_Drop or Sit, has to follow the step it was sent after
+	set_may_overtake(PacketFamily::Init, true);
+	set_may_overtake(PacketFamily::Connection, true);
+	set_may_overtake(PacketFamily::Message, true);
+	set_may_overtake(PacketFamily::Players, true);
+}
+
+void Net_Send_Filter::set_rule(PacketID id, Rule rule)
+{
+	m_rules[packet_id_hash(id)] = std::move(rule);
+}
+
+void Net_Send_Filter::clear_rule(PacketID id)
+{
+	m_rules.erase(packet_id_hash(id));
+}
+
+void Net_Send_Filter::clear_rules()
+{
+	m_rules.clear();
+}
+
+void Net_Send_Filter::set_may_overtake(PacketFamily family, bool may_overtake)
+{
+	m_may_overtake[eo_byte(family)] = may_overtake;
+}
+
+bool Net_Send_Filter::ready(unsigned id, const Rule& rule, clock::time_point now,
+                            clock::time_point* next) const
+{
+	auto it = m_last_release.find(id);
+
+	if (it == m_last_release.end() || now - it->second >= rule.interval)
+		return true;
+
+	if (next)
+		*next = it->second + rule.interval;
+
+	return false;
+}
+
+bool Net_Send_Filter::accept(const Client_Packet& packet)
+{
+	auto id = packet.vid();
+	int direction;
+
+	if (id == cli::Face_Player::id)
+	{
+		direction = int(packet.as<cli::Face_Player>().direction);
+
+		if (direction == m_direction)
+			return false;
+	}
+	else if (id == cli::Walk_Player::id)
+		direction = int(packet.as<cli::Walk_Player>().walk.direction);
+	else if (id == cli::Walk_Admin::id)
+		direction = int(packet.as<cli::Walk_Admin>().walk.direction);
+	else if (id == cli::Walk_Spec::id)
+		direction = int(packet.as<cli::Walk_Spec>().walk.direction);
+	else if (id == cli::Attack_Use::id)
+		direction = int(packet.as<cli::Attack_Use>().direction);
+	else
+		return true;
+
+	m_direction = direction;
+	return true;
+}
+
+bool Net_Send_Filter::submit(Packet& packet, const Client_Packet& source, clock::time_point now,
+                             std::vector<PacketID>& dropped)
+{
+	unsigned id = packet_id_hash(packet.id);
+	auto rule_it = m_rules.find(id);
+
+	// Anything without a rule is only held to keep it behind actions which are
+	if (rule_it == m_rules.end())
+	{
+		if (m_held.empty() || m_may_overtake[eo_byte(packet.id.first)])
+			return true;
+
+		packet.serialize(source);
+		m_held.push_back(std::move(packet));
+		return false;
+	}
+
+	auto&& rule = rule_it->second;
+
+	auto obsolete = [&](const Packet& held)
+	{
+		unsigned held_id = packet_id_hash(held.id);
+
+		if (rule.latest && held_id == id)
+			return true;
+
+		return std::any_of(rule.replaces.begin(), rule.replaces.end(),
+			[held_id](PacketID replaced_id) { return packet_id_hash(replaced_id) == held_id; });
+	};
+
+	for (auto it = m_held.begin(); it != m_held.end(); )
+	{
+		if (obsolete(*it))
+		{
+			dropped.push_back(it->id);
+			it = m_held.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	auto held = std::count_if(m_held.begin(), m_held.end(),
+		[&packet](const Packet& held) { return held.id == packet.id; });
+
+	if (std::size_t(held) >= rule.max_held)
+	{
+		dropped.push_back(packet.id);
+
+		// accept() assumed this one would be sent
+		m_direction = -1;
+		return false;
+	}
+
+	// Actions stay in order, so nothing overtakes a held one
+	if (m_held.empty() && ready(id, rule, now))
+	{
+		m_last_release[id] = now;
+		return true;
+	}
+
+	packet.held = copy_timed(source);
+
+	if (!packet.held)
+		packet.serialize(source);
+
+	m_held.push_back(std::move(packet));
+	return false;
+}
+
+Net_Send_Filter::clock::time_point Net_Send_Filter::release(clock::time_point now, std::vector<Packet>& out)
+{
+	while (!m_held.empty())
+	{
+		auto&& packet = m_held.front();
+		unsigned id = packet_id_hash(packet.id);
+		auto rule_it = m_rules.find(id);
+
+		if (rule_it != m_rules.end())
+		{
+			auto next = clock::time_point::max();
+
+			if (!ready(id, rule_it->second, now, &next))
+				return next;
+		}
+
+		if (packet.held)
+		{
+			advance_timestamp(*packet.held, now - packet.queued);
+			packet.serialize(*packet.held);
+			packet.held.reset();
+		}
+
+		m_last_release[id] = now;
+		out.push_back(std::move(packet));
+		m_held.pop_front();
+	}
+
+	return clock::time_point::max();
+}
+
+void Net_Send_Filter::observe(const Server_Packet& packet)
+{
+	auto id = packet.vid();
+
+	if (id == srv::Welcome_Reply::id || id == srv::Warp_Agree::id || id == srv::Refresh_Reply::id)
+		m_direction = -1;
+}
+
+void Net_Send_Filter::reset()
+{
+	m_held.clear();
+	m_last_release.clear();
+	m_direction = -1;
+}
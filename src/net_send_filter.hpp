@@ -0,0 +1,104 @@
+#ifndef EO_NET_SEND_FILTER_HPP
+#define EO_NET_SEND_FILTER_HPP
+
+#include "net_telemetry.hpp"
+#include "packet/packet_base.hpp"
+
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Cuts down redundant player actions before NetClient queues them for sending
+//  - Turning to face the direction already faced is dropped
+//  - Actions sent faster than the server accepts them are held back
+//  - A held action is replaced by a newer one which makes it obsolete
+// Held actions are released in the order they were sent
+// Other packets wait behind held actions too, unless their family is allowed to overtake them
+
+class Net_Send_Filter
+{
+	public:
+		using clock = Net_Telemetry::clock;
+
+		struct Rule
+		{
+			// Minimum time between two packets of this type being released
+			clock::duration interval{};
+
+			// A newer packet of this type replaces a held one instead of waiting behind it
+			bool latest = false;
+
+			// Held packet types which this one makes obsolete
+			std::vector<PacketID> replaces;
+
+			// Further packets of this type are dropped while this many are held
+			std::size_t max_held = 1;
+		};
+
+		struct Packet
+		{
+			PacketID id;
+
+			// Serialized without the length or sequence number
+			std::string body;
+
+			clock::duration serialize_time{};
+			clock::time_point queued;
+
+			// Held Walk and Attack packets wait unserialized so their timestamps can be advanced on release
+			std::unique_ptr<Client_Packet> held;
+
+			// Fills in body and serialize_time
+			void serialize(const Client_Packet& packet);
+		};
+
+	private:
+		std::unordered_map<unsigned, Rule> m_rules;
+		std::unordered_map<unsigned, clock::time_point> m_last_release;
+		std::deque<Packet> m_held;
+
+		// Families sent straight away even while actions are held, indexed by family
+		std::array<bool, 256> m_may_overtake{};
+
+		// Last direction sent in a Face, Walk or Attack, -1 if unknown
+		int m_direction = -1;
+
+		bool ready(unsigned id, const Rule& rule, clock::time_point now,
+		           clock::time_point* next = nullptr) const;
+
+	public:
+		// Installs the default rules, see net_send_filter.cpp
+		Net_Send_Filter();
+
+		void set_rule(PacketID id, Rule rule);
+		void clear_rule(PacketID id);
+		void clear_rules();
+
+		// Only families which don't depend on where the character is should overtake held actions
+		void set_may_overtake(PacketFamily family, bool may_overtake);
+
+		// Returns false if sending the packet would change nothing
+		bool accept(const Client_Packet& packet);
+
+		// Returns true if the packet can be sent now, otherwise it is held or dropped
+		// packet is left unserialized, source is only copied or serialized if it is held
+		// The types of any packets dropped are appended to dropped
+		bool submit(Packet& packet, const Client_Packet& source, clock::time_point now,
+		            std::vector<PacketID>& dropped);
+
+		// Moves held packets which can now be sent to out, serialized
+		// Returns when the next one can be released, or time_point::max() if none are held
+		clock::time_point release(clock::time_point now, std::vector<Packet>& out);
+
+		// Server packets which move or turn the character make the known direction stale
+		void observe(const Server_Packet& packet);
+
+		// Drops held packets and forgets the direction and release times
+		void reset();
+};
+
+#endif // EO_NET_SEND_FILTER_HPP
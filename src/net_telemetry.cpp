@@ -0,0 +1,233 @@
+#include "net_telemetry.hpp"
+
+#include "packet/eo_packets.hpp"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <cmath>
+
+static int histogram_bucket(std::uint64_t ns)
+{
+	int bucket = 0;
+
+	while (ns > 1 && bucket < Net_Telemetry::histogram_buckets - 1)
+	{
+		ns >>= 1;
+		++bucket;
+	}
+
+	return bucket;
+}
+
+void Net_Telemetry::Histogram::add(std::uint64_t ns)
+{
+	++buckets[histogram_bucket(ns)];
+}
+
+std::uint64_t Net_Telemetry::Histogram::percentile(double p) const
+{
+	std::uint64_t total = 0;
+
+	for (auto n : buckets)
+		total += n;
+
+	if (total == 0)
+		return 0;
+
+	auto target = std::uint64_t(p / 100.0 * double(total));
+	std::uint64_t seen = 0;
+
+	for (int i = 0; i < histogram_buckets; ++i)
+	{
+		seen += buckets[i];
+
+		if (seen > target)
+			return std::uint64_t(1) << (i + 1);
+	}
+
+	return std::uint64_t(1) << histogram_buckets;
+}
+
+Net_Telemetry::Histogram& Net_Telemetry::Histogram::operator+=(const Histogram& other)
+{
+	for (int i = 0; i < histogram_buckets; ++i)
+		buckets[i] += other.buckets[i];
+
+	return *this;
+}
+
+Net_Telemetry::Packet_Stats& Net_Telemetry::Packet_Stats::operator+=(const Packet_Stats& other)
+{
+	packets += other.packets;
+	bytes += other.bytes;
+	decode_ns += other.decode_ns;
+	handler_ns += other.handler_ns;
+	coalesced += other.coalesced;
+	decode_hist += other.decode_hist;
+	handler_hist += other.handler_hist;
+
+	return *this;
+}
+
+void Net_Telemetry::Latency::add(clock::duration rtt)
+{
+	double ms = std::chrono::duration<double, std::milli>(rtt).count();
+
+	if (samples == 0)
+	{
+		min_ms = ms;
+		srtt_ms = ms;
+		jitter_ms = ms / 2.0;
+	}
+	else
+	{
+		min_ms = std::min(min_ms, ms);
+		jitter_ms = 0.75 * jitter_ms + 0.25 * std::abs(srtt_ms - ms);
+		srtt_ms = 0.875 * srtt_ms + 0.125 * ms;
+	}
+
+	last_ms = ms;
+	++samples;
+}
+
+static void write_histogram_json(std::string& out, const Net_Telemetry::Histogram& hist)
+{
+	// Trailing empty buckets are trimmed to keep the output compact
+	auto last = std::find_if(hist.buckets.rbegin(), hist.buckets.rend(),
+		[](std::uint64_t n) { return n != 0; }).base();
+
+	out += '[';
+
+	for (auto it = hist.buckets.begin(); it != last; ++it)
+	{
+		if (it != hist.buckets.begin())
+			out += ',';
+
+		out += std::to_string(*it);
+	}
+
+	out += ']';
+}
+
+static void write_table_json(std::string& out, const Net_Telemetry::Stats_Table& table)
+{
+	out += '[';
+
+	for (auto it = table.begin(); it != table.end(); ++it)
+	{
+		auto family = PacketFamily(it->first >> 8);
+		auto action = PacketAction(it->first & 0xFF);
+		auto&& stats = it->second;
+
+		if (it != table.begin())
+			out += ',';
+
+		out += fmt::format(
+			"{{\"family\":\"{}\",\"action\":\"{}\",\"id\":{},"
+			"\"packets\":{},\"bytes\":{},\"decode_ns\":{},\"handler_ns\":{},\"coalesced\":{},",
+			name(family), name(action), it->first,
+			stats.packets, stats.bytes, stats.decode_ns, stats.handler_ns, stats.coalesced
+		);
+
+		out += "\"decode_hist\":";
+		write_histogram_json(out, stats.decode_hist);
+		out += ",\"handler_hist\":";
+		write_histogram_json(out, stats.handler_hist);
+		out += '}';
+	}
+
+	out += ']';
+}
+
+std::string Net_Telemetry::Snapshot::to_json() const
+{
+	std::string out;
+
+	out += "{\"histogram_unit\":\"log2_ns\",\"incoming\":";
+	write_table_json(out, incoming);
+	out += ",\"outgoing\":";
+	write_table_json(out, outgoing);
+
+	out += fmt::format(
+		",\"latency\":{{\"samples\":{},\"last_ms\":{:.3f},\"min_ms\":{:.3f},"
+		"\"srtt_ms\":{:.3f},\"jitter_ms\":{:.3f}}}}}",
+		latency.samples, latency.last_ms, latency.min_ms,
+		latency.srtt_ms, latency.jitter_ms
+	);
+
+	return out;
+}
+
+void Net_Telemetry::record(direction_t dir, PacketID id, std::size_t bytes,
+                           clock::duration decode_time, clock::duration handler_time)
+{
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	auto decode_ns = std::uint64_t(duration_cast<nanoseconds>(decode_time).count());
+	auto handler_ns = std::uint64_t(duration_cast<nanoseconds>(handler_time).count());
+
+	std::unique_lock lock(m_mutex);
+
+	auto&& stats = m_tables[dir][packet_id_hash(id)];
+
+	++stats.packets;
+	stats.bytes += bytes;
+	stats.decode_ns += decode_ns;
+	stats.handler_ns += handler_ns;
+	stats.decode_hist.add(decode_ns);
+	stats.handler_hist.add(handler_ns);
+}
+
+void Net_Telemetry::record_coalesced(PacketID id, std::size_t bytes, clock::duration decode_time)
+{
+	auto decode_ns = std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(decode_time).count());
+
+	std::unique_lock lock(m_mutex);
+
+	auto&& stats = m_tables[incoming][packet_id_hash(id)];
+
+	++stats.packets;
+	++stats.coalesced;
+	stats.bytes += bytes;
+	stats.decode_ns += decode_ns;
+	stats.decode_hist.add(decode_ns);
+}
+
+void Net_Telemetry::record_filtered(PacketID id)
+{
+	std::unique_lock lock(m_mutex);
+
+	++m_tables[outgoing][packet_id_hash(id)].coalesced;
+}
+
+void Net_Telemetry::record_rtt(clock::duration rtt)
+{
+	std::unique_lock lock(m_mutex);
+
+	m_latency.add(rtt);
+}
+
+Net_Telemetry::Latency Net_Telemetry::latency() const
+{
+	std::unique_lock lock(m_mutex);
+
+	return m_latency;
+}
+
+Net_Telemetry::Snapshot Net_Telemetry::snapshot() const
+{
+	std::unique_lock lock(m_mutex);
+
+	return Snapshot{m_tables[incoming], m_tables[outgoing], m_latency};
+}
+
+void Net_Telemetry::reset()
+{
+	std::unique_lock lock(m_mutex);
+
+	m_tables[incoming].clear();
+	m_tables[outgoing].clear();
+	m_latency = Latency{};
+}
@@ -0,0 +1,108 @@
+#ifndef EO_NET_TELEMETRY_HPP
+#define EO_NET_TELEMETRY_HPP
+
+#include "packet/packet_base.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Per-packet-type counters for NetClient
+// Entries are keyed by packet_id_hash (family << 8 | action)
+
+class Net_Telemetry
+{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		enum direction_t
+		{
+			incoming,
+			outgoing
+		};
+
+		// Bucket i counts samples in the range [2^i, 2^(i+1)) nanoseconds
+		static constexpr int histogram_buckets = 32;
+
+		struct Histogram
+		{
+			std::array<std::uint64_t, histogram_buckets> buckets = {};
+
+			void add(std::uint64_t ns);
+
+			// Returns the upper bound of the bucket containing the given percentile
+			std::uint64_t percentile(double p) const;
+
+			Histogram& operator+=(const Histogram& other);
+		};
+
+		struct Packet_Stats
+		{
+			std::uint64_t packets = 0;
+			std::uint64_t bytes = 0;
+
+			// Incoming: decode + unserialize, Outgoing: serialize + encode
+			std::uint64_t decode_ns = 0;
+			// Incoming: signal handlers, Outgoing: time queued behind other packets
+			std::uint64_t handler_ns = 0;
+
+			// Incoming: dropped in favour of a newer packet, see net_coalescer.hpp
+			// Outgoing: dropped as redundant, see net_send_filter.hpp, and not counted in packets
+			std::uint64_t coalesced = 0;
+
+			Histogram decode_hist;
+			Histogram handler_hist;
+
+			Packet_Stats& operator+=(const Packet_Stats& other);
+		};
+
+		using Stats_Table = std::map<unsigned, Packet_Stats>;
+
+		// Moving round-trip estimate using the RFC 6298 weights
+		struct Latency
+		{
+			std::uint64_t samples = 0;
+			double last_ms = 0.0;
+			double min_ms = 0.0;
+			double srtt_ms = 0.0;
+			double jitter_ms = 0.0;
+
+			void add(clock::duration rtt);
+		};
+
+		struct Snapshot
+		{
+			Stats_Table incoming;
+			Stats_Table outgoing;
+			Latency latency;
+
+			std::string to_json() const;
+		};
+
+	private:
+		mutable std::mutex m_mutex;
+		Stats_Table m_tables[2];
+		Latency m_latency;
+
+	public:
+		void record(direction_t dir, PacketID id, std::size_t bytes,
+		            clock::duration decode_time, clock::duration handler_time = {});
+
+		// Counts a packet which was decoded but never handled
+		void record_coalesced(PacketID id, std::size_t bytes, clock::duration decode_time);
+
+		// Counts a packet which was never sent
+		void record_filtered(PacketID id);
+
+		void record_rtt(clock::duration rtt);
+
+		Latency latency() const;
+		Snapshot snapshot() const;
+
+		void reset();
+};
+
+#endif // EO_NET_TELEMETRY_HPP
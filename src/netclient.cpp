@@ -1,17 +1,28 @@
 #include "netclient.hpp"
 
+#include "net_capture.hpp"
+#include "net_coalescer.hpp"
+#include "net_download.hpp"
+#include "net_send_filter.hpp"
+
 #include "data/eo_stream.hpp"
 #include "packet/eo_packets.hpp"
 #include "packet/packet_processor.hpp"
 
+#include "cio/cio.hpp"
 #include "trace.hpp"
 
 #include <asio.hpp>
 
+#include <algorithm>
 #include <array>
+#include <cctype>
+#include <chrono>
 #include <deque>
+#include <iterator>
 #include <memory>
 #include <optional>
+#include <vector>
 
 namespace ip = asio::ip;
 using tcp = asio::ip::tcp;
@@ -25,8 +36,8 @@ static void write_packet_hex(cio::stream& os, const char* data, std::size_t n)
 	for (std::size_t i = 0; i < n; ++i)
 	{
 		eo_byte c = eo_byte(data[i]);
-		cio::out << hex[(c & 0xF0) >> 8] << hex[c & 0x0F];
-		cio::out << ' ';
+		os << hex[(c & 0xF0) >> 4] << hex[c & 0x0F];
+		os << ' ';
 	}
 }
 
@@ -37,10 +48,21 @@ static cio::stream& operator<<(cio::stream& os, EO_Stream_Reader& reader)
 	return os;
 }
 
-static cio::stream& operator<<(cio::stream& os, EO_Stream_Builder& builder)
+// Character names are compared without regard to case, as the server does
+static bool same_name(std::string_view a, std::string_view b)
 {
-	std::string str = builder.get();
-	write_packet_hex(os, str.data(), str.size());
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+		[](char x, char y) { return std::tolower(eo_byte(x)) == std::tolower(eo_byte(y)); });
+}
+
+struct hex_dump
+{
+	std::string_view data;
+};
+
+static cio::stream& operator<<(cio::stream& os, hex_dump dump)
+{
+	write_packet_hex(os, dump.data.data(), dump.data.size());
 	return os;
 }
 
@@ -49,17 +71,85 @@ struct NetClient::impl_t
 	// m_netclient and m_impl are valid for the lifetime of this class
 	NetClient& m_netclient;
 
-	asio::io_context m_io_ctx;
+	// Null when sharing an io_context owned by the caller
+	std::unique_ptr<asio::io_context> m_owned_io_ctx;
+
+	// Serializes this session's handlers when the io_context runs on several threads
+	asio::strand<asio::io_context::executor_type> m_strand;
+
+	tcp::resolver m_resolver;
 	tcp::socket m_client;
 
 	state_t m_state = disconnected;
 
-	std::array<char, 0xFFFF> m_client_read_buffer;
+	std::array<char, 2> m_client_read_header;
+	std::vector<char> m_client_read_buffer;
 	std::size_t m_client_read_state = 0;
 	Packet_Processor m_processor;
+	Net_Telemetry m_telemetry;
+	Net_Capture m_capture;
+	Net_Coalescer m_coalescer;
 	unsigned m_seq_start = 0;
 	unsigned m_seq = 0;
 
+	struct ping_probe_t
+	{
+		eo_short token;
+		Net_Telemetry::clock::time_point sent;
+	};
+
+	asio::steady_timer m_ping_timer;
+	std::chrono::milliseconds m_ping_interval{0};
+	ping_method_t m_ping_method = ping_message;
+	std::string m_ping_find_name;
+	std::deque<ping_probe_t> m_ping_probes;
+	eo_short m_ping_token = 0;
+
+	// Probes older than this many outstanding requests are considered lost
+	static constexpr std::size_t max_ping_probes = 8;
+
+	// Handlers from NetClient::on(), indexed by family then action
+	// Only families with a handler have a table allocated
+	using handler_signal_t = util::signal<void(Server_Packet&)>;
+	std::array<std::unique_ptr<std::array<handler_signal_t, 256>>, 256> m_handlers;
+
+	// Decoded packets waiting for dispatch_incoming()
+	std::vector<Net_Coalescer::Entry> m_incoming;
+	std::vector<Net_Coalescer::Entry> m_dispatching;
+	bool m_dispatch_active = false;
+
+	// Init_Init file replies are passed to m_file_sink in pieces instead of being buffered
+	std::shared_ptr<Net_File_Sink> m_file_sink;
+	std::shared_ptr<Net_File_Sink> m_stream_sink;
+	std::array<char, 2> m_stream_reply;
+	std::size_t m_stream_reply_size = 0;
+	std::size_t m_stream_remaining = 0;
+	Net_Telemetry::clock::duration m_stream_time{};
+
+	using outgoing_t = Net_Send_Filter::Packet;
+
+	Net_Send_Filter m_send_filter;
+	asio::steady_timer m_release_timer;
+	std::vector<outgoing_t> m_released;
+	std::vector<PacketID> m_filtered;
+
+	// Packets waiting for the current write to finish, one queue per lane_t
+	std::array<std::deque<outgoing_t>, lane_count> m_send_lanes;
+	std::array<lane_t, 256> m_family_lanes;
+	std::string m_write_buffer;
+	bool m_write_active = false;
+
+	// Queued packets are combined in to writes of about this size
+	// Kept small so a busy lower lane can't hold up input for long
+	static constexpr std::size_t write_batch_size = 1024;
+
+	// Larger read buffers are released after use to keep idle sessions small
+	// Frames bigger than this are also candidates for streaming
+	static constexpr std::size_t read_buffer_keep = 4096;
+
+	// Action, family, reply code and file ID
+	static constexpr std::size_t stream_prefix_size = 4;
+
 	unsigned next_seq()
 	{
 		unsigned result = (m_seq_start + m_seq) & 0xFFFFFFFFU;
@@ -72,6 +162,15 @@ struct NetClient::impl_t
 		if (m_state != state)
 		{
 			m_state = state;
+
+			if (state == ready)
+				schedule_ping();
+			else
+				cancel_ping();
+
+			// Packets received before the state changed are delivered first
+			dispatch_incoming();
+
 			m_netclient.sig_state_change(state);
 		}
 	}
@@ -82,18 +181,9 @@ struct NetClient::impl_t
 
 		set_state(connecting);
 
-		tcp::resolver resolver(m_io_ctx);
-
-		struct state_t
-		{
-			tcp::resolver::results_type::iterator it;
-			tcp::resolver::results_type::iterator end;
-		};
-
-		auto&& state = std::make_shared<state_t>();
-
-		resolver.async_resolve(host, port, tcp::resolver::numeric_service,
-			[this, state](asio::error_code ec, tcp::resolver::results_type resolve_result)
+		// The resolver must outlive the operation, or it is cancelled
+		m_resolver.async_resolve(host, port, tcp::resolver::numeric_service,
+			[this](asio::error_code ec, tcp::resolver::results_type resolve_result)
 			{
 				if (ec)
 				{
@@ -103,7 +193,7 @@ struct NetClient::impl_t
 				}
 
 				async_connect(m_client, resolve_result,
-					[this, state](asio::error_code ec, const asio::ip::tcp::endpoint& endpoint)
+					[this](asio::error_code ec, const asio::ip::tcp::endpoint& endpoint)
 					{
 						if (ec)
 						{
@@ -113,7 +203,15 @@ struct NetClient::impl_t
 						}
 
 						trace_log("Connected to " << endpoint.address().to_string());
+
+						// Requests are often sent back to back, which Nagle's algorithm would hold up
+						asio::error_code option_ec;
+						m_client.set_option(tcp::no_delay(true), option_ec);
+
 						set_state(connected);
+
+						m_client_read_state = 0;
+						do_read();
 					}
 				);
 			}
@@ -126,9 +224,23 @@ struct NetClient::impl_t
 		{
 			trace_log("closing client");
 
+			m_resolver.cancel();
+
 			if (m_client.is_open())
 				m_client.close();
 
+			if (m_stream_sink)
+			{
+				m_stream_sink->end(false);
+				m_stream_sink = nullptr;
+			}
+
+			for (auto&& lane : m_send_lanes)
+				lane.clear();
+
+			m_release_timer.cancel();
+			m_send_filter.reset();
+
 			set_state(disconnected);
 		}
 	}
@@ -137,8 +249,10 @@ struct NetClient::impl_t
 	{
 		if (m_client_read_state == 0)
 		{
+			release_read_buffer();
+
 			asio::async_read(m_client,
-				asio::buffer(&m_client_read_buffer[0], 2),
+				asio::buffer(m_client_read_header),
 				[this](const asio::error_code& error, std::size_t bytes_transferred)
 				{
 					if (error)
@@ -148,13 +262,18 @@ struct NetClient::impl_t
 						return;
 					}
 
-					unsigned a = eo_byte(m_client_read_buffer[0]);
-					unsigned b = eo_byte(m_client_read_buffer[1]);
+					unsigned a = eo_byte(m_client_read_header[0]);
+					unsigned b = eo_byte(m_client_read_header[1]);
 
 					unsigned length = eo_number_decode(a, b);
 
 					m_client_read_state = std::size_t(length);
-					m_io_ctx.post([this]() { do_read(); });
+
+					// Captures need whole frames, so streaming is skipped while recording
+					if (m_file_sink && m_client_read_state > read_buffer_keep && !m_capture.active())
+						asio::post(m_strand, [this]() { read_prefix(); });
+					else
+						asio::post(m_strand, [this]() { do_read(); });
 				}
 			);
 		}
@@ -162,8 +281,10 @@ struct NetClient::impl_t
 		{
 			trace_log("attempting to read " << m_client_read_state << " bytes...");
 
+			m_client_read_buffer.resize(m_client_read_state);
+
 			asio::async_read(m_client,
-				asio::buffer(&m_client_read_buffer[0], m_client_read_state),
+				asio::buffer(m_client_read_buffer),
 				[this](const asio::error_code& error, std::size_t bytes_transferred)
 				{
 					if (error)
@@ -173,134 +294,643 @@ struct NetClient::impl_t
 						return;
 					}
 
-					m_processor.decode(&m_client_read_buffer[0], m_client_read_state);
+					handle_frame(Net_Telemetry::clock::now());
+				}
+			);
+		}
+	}
 
-					EO_Stream_Reader reader({
-						m_client_read_buffer.data(),
-						m_client_read_state
-					});
+	// arrival is stamped in the read handler so RTT excludes decode and dispatch time
+	void handle_frame(Net_Telemetry::clock::time_point arrival)
+	{
+		// The buffer is only as long as the frame, and decode() looks at the first two bytes
+		if (m_client_read_state < 2)
+		{
+			trace_log("dropping unknown packet (too short)");
+			m_client_read_state = 0;
+			asio::post(m_strand, [this]() { do_read(); });
+			return;
+		}
 
-					if (m_client_read_state < 2)
-					{
-						trace_log("dropping unknown packet (too short)");
-						m_io_ctx.post([this]() { do_read(); });
-						return;
-					}
+		auto decode_start = Net_Telemetry::clock::now();
 
-					trace_log("dump " << reader);
+		m_capture.record(Net_Capture::frame_in, {
+			{m_client_read_header.data(), m_client_read_header.size()},
+			{m_client_read_buffer.data(), m_client_read_state}
+		});
 
-					auto packet = eo_protocol::unserialize(reader);
+		m_processor.decode(m_client_read_buffer.data(), m_client_read_state);
 
-					if (!packet)
-					{
-						reader.seek(0);
+		EO_Stream_Reader reader({
+			m_client_read_buffer.data(),
+			m_client_read_state
+		});
 
-						auto action = PacketAction(reader.get_byte());
-						auto family = PacketFamily(reader.get_byte());
+		trace_log("dump " << reader);
 
-						trace_log("dropping unknown packet: " << name(family) << "_" << name(action));
+		auto action = PacketAction(eo_byte(m_client_read_buffer[0]));
+		auto family = PacketFamily(eo_byte(m_client_read_buffer[1]));
 
-						m_io_ctx.post([this]() { do_read(); });
-						return;
-					}
+		if (!wanted({family, action}))
+		{
+			m_telemetry.record(Net_Telemetry::incoming, {family, action},
+			                   m_client_read_state + 2, Net_Telemetry::clock::now() - decode_start);
 
-					auto packet_id = packet->vid();
+			m_client_read_state = 0;
+			asio::post(m_strand, [this]() { do_read(); });
+			return;
+		}
 
-					// Hijack pings to handle them automatically
-					// And Init_Init to initialize packet processor
-					if (packet_id == srv::Connection_Player::id)
-					{
-						handle_ping(packet->as<srv::Connection_Player>());
-						return;
-					}
-					else if (packet_id == srv::Init_Init::id)
-					{
-						auto& init = packet->as<srv::Init_Init>();
+		auto packet = eo_protocol::unserialize(reader);
+
+		auto decode_time = Net_Telemetry::clock::now() - decode_start;
+		std::size_t frame_size = m_client_read_state + 2;
+
+		if (!packet)
+		{
+			trace_log("dropping unknown packet: " << name(family) << "_" << name(action));
+
+			m_telemetry.record(Net_Telemetry::incoming, {family, action},
+			                   frame_size, decode_time);
+
+			m_client_read_state = 0;
+			asio::post(m_strand, [this]() { do_read(); });
+			return;
+		}
+
+		auto packet_id = packet->vid();
+
+		m_send_filter.observe(*packet);
+
+		// Hijack pings to handle them automatically
+		// And Init_Init to initialize packet processor
+		if (packet_id == srv::Connection_Player::id)
+		{
+			m_telemetry.record(Net_Telemetry::incoming, packet_id,
+			                   frame_size, decode_time);
+
+			handle_ping(packet->as<srv::Connection_Player>());
+
+			m_client_read_state = 0;
+			asio::post(m_strand, [this]() { do_read(); });
+			return;
+		}
+		else if (packet_id == srv::Init_Init::id)
+		{
+			auto& init = packet->as<srv::Init_Init>();
+
+			if (init.reply_code == eo_protocol::InitReply::OK)
+			{
+				m_processor.set_multi(init.u.ok.multi[0], init.u.ok.multi[1]);
+				m_seq_start = init.u.ok.seq_start();
+
+				m_capture.record_multi(m_processor.multi_d(), m_processor.multi_e());
+				m_capture.record_seq(m_seq_start);
+				set_state(ready);
+			}
+		}
+
+		trace_log("recieved packet: " << name(packet_id.first) << "_" << name(packet_id.second));
+
+		m_client_read_state = 0;
+		asio::post(m_strand, [this]() { do_read(); });
+
+		if (!m_ping_probes.empty() && handle_pong(*packet, arrival))
+		{
+			m_telemetry.record(Net_Telemetry::incoming, packet_id,
+			                   frame_size, decode_time);
+			return;
+		}
+
+		queue_incoming({std::move(packet), frame_size, decode_time});
+	}
+
+	void read_prefix()
+	{
+		m_client_read_buffer.resize(stream_prefix_size);
+
+		asio::async_read(m_client,
+			asio::buffer(m_client_read_buffer),
+			[this](const asio::error_code& error, std::size_t bytes_transferred)
+			{
+				if (error)
+				{
+					trace_log("read error: " << error.message());
+					disconnect();
+					return;
+				}
+
+				if (begin_stream())
+				{
+					read_stream();
+					return;
+				}
+
+				// Not a file, read the rest of the frame after the prefix
+				m_client_read_buffer.resize(m_client_read_state);
 
-						if (init.reply_code == eo_protocol::InitReply::OK)
+				asio::async_read(m_client,
+					asio::buffer(m_client_read_buffer.data() + stream_prefix_size,
+					             m_client_read_state - stream_prefix_size),
+					[this](const asio::error_code& error, std::size_t bytes_transferred)
+					{
+						if (error)
 						{
-							m_processor.set_multi(init.u.ok.multi[0], init.u.ok.multi[1]);
-							m_seq_start = init.u.ok.seq_start();
-							set_state(ready);
+							trace_log("read error: " << error.message());
+							disconnect();
+							return;
 						}
+
+						handle_frame(Net_Telemetry::clock::now());
 					}
+				);
+			}
+		);
+	}
+
+	bool begin_stream()
+	{
+		auto&& prefix = m_client_read_buffer;
+
+		// Init_Init is the only packet sent without encoding
+		if (eo_byte(prefix[0]) != 0xFF || eo_byte(prefix[1]) != 0xFF)
+			return false;
+
+		auto type = InitReply(eo_byte(prefix[2]));
+		bool is_map = (type == InitReply::File_Map);
+
+		if (!is_map && type != InitReply::File_EIF && type != InitReply::File_ENF
+		 && type != InitReply::File_ESF && type != InitReply::File_ECF)
+			return false;
+
+		// Maps have no file ID, so the last prefix byte is already content
+		std::size_t reply_size = is_map ? 1 : 2;
+		std::size_t content_offset = 2 + reply_size;
+		int file_id = is_map ? 0 : eo_number_decode(eo_byte(prefix[3]));
+
+		auto start = Net_Telemetry::clock::now();
+
+		if (!m_file_sink->begin(type, file_id, m_client_read_state - content_offset))
+			return false;
+
+		m_stream_sink = m_file_sink;
+		m_stream_reply = {prefix[2], prefix[3]};
+		m_stream_reply_size = reply_size;
+		m_stream_remaining = m_client_read_state - stream_prefix_size;
 
-					trace_log("recieved packet: " << name(packet_id.first) << "_" << name(packet_id.second));
+		if (content_offset < stream_prefix_size)
+			m_stream_sink->data({prefix.data() + content_offset, stream_prefix_size - content_offset});
 
-					m_client_read_state = 0;
-					m_io_ctx.post([this]() { do_read(); });
+		m_stream_time = Net_Telemetry::clock::now() - start;
 
-					m_netclient.sig_incoming_packet(*packet);
+		return true;
+	}
+
+	void read_stream()
+	{
+		if (m_stream_remaining == 0)
+		{
+			end_stream();
+			return;
+		}
+
+		m_client_read_buffer.resize(std::min(m_stream_remaining, read_buffer_keep));
+
+		asio::async_read(m_client,
+			asio::buffer(m_client_read_buffer),
+			[this](const asio::error_code& error, std::size_t bytes_transferred)
+			{
+				if (error)
+				{
+					trace_log("read error: " << error.message());
+					disconnect();
+					return;
 				}
-			);
+
+				auto start = Net_Telemetry::clock::now();
+
+				m_stream_sink->data({m_client_read_buffer.data(), m_client_read_buffer.size()});
+				m_stream_remaining -= m_client_read_buffer.size();
+
+				m_stream_time += Net_Telemetry::clock::now() - start;
+
+				read_stream();
+			}
+		);
+	}
+
+	void end_stream()
+	{
+		auto start = Net_Telemetry::clock::now();
+
+		m_stream_sink->end(true);
+		m_stream_sink = nullptr;
+
+		// Handlers still see the reply, but with empty content
+		EO_Stream_Reader reader({m_stream_reply.data(), m_stream_reply_size});
+		auto packet = std::make_shared<srv::Init_Init>(reader);
+
+		m_stream_time += Net_Telemetry::clock::now() - start;
+
+		trace_log("streamed file: " << m_client_read_state << " bytes");
+
+		queue_incoming({std::move(packet), m_client_read_state + 2, m_stream_time});
+
+		m_client_read_state = 0;
+		asio::post(m_strand, [this]() { do_read(); });
+	}
+
+	void queue_incoming(Net_Coalescer::Entry entry)
+	{
+		m_incoming.push_back(std::move(entry));
+
+		// An owned io_context is drained by poll() once it has read everything available
+		if (!m_owned_io_ctx && m_incoming.size() == 1)
+			asio::post(m_strand, [this]() { dispatch_incoming(); });
+	}
+
+	void dispatch_incoming()
+	{
+		if (m_dispatch_active || m_incoming.empty())
+			return;
+
+		m_dispatch_active = true;
+		m_dispatching.swap(m_incoming);
+
+		std::size_t dropped = m_coalescer.coalesce(m_dispatching);
+
+		if (dropped > 0)
+			trace_log("coalesced " << dropped << " of " << m_dispatching.size() << " packets");
+
+		for (auto&& entry : m_dispatching)
+		{
+			auto packet_id = entry.packet->vid();
+
+			if (entry.superseded)
+			{
+				m_telemetry.record_coalesced(packet_id, entry.frame_size, entry.decode_time);
+				continue;
+			}
+
+			auto handler_start = Net_Telemetry::clock::now();
+
+			deliver(*entry.packet);
+
+			m_telemetry.record(Net_Telemetry::incoming, packet_id, entry.frame_size,
+			                   entry.decode_time, Net_Telemetry::clock::now() - handler_start);
 		}
+
+		m_dispatching.clear();
+		m_dispatch_active = false;
+	}
+
+	handler_signal_t* find_handlers(PacketID id)
+	{
+		auto&& family_handlers = m_handlers[eo_byte(id.first)];
+
+		if (!family_handlers)
+			return nullptr;
+
+		auto&& handlers = (*family_handlers)[eo_byte(id.second)];
+
+		return handlers.empty() ? nullptr : &handlers;
+	}
+
+	util::connection subscribe(PacketID id, handler_signal_t::slot_type fn)
+	{
+		auto&& family_handlers = m_handlers[eo_byte(id.first)];
+
+		if (!family_handlers)
+			family_handlers = std::make_unique<std::array<handler_signal_t, 256>>();
+
+		return (*family_handlers)[eo_byte(id.second)].connect(std::move(fn));
+	}
+
+	void deliver(Server_Packet& packet)
+	{
+		if (auto handlers = find_handlers(packet.vid()))
+			(*handlers)(packet);
+
+		m_netclient.sig_incoming_packet(packet);
+	}
+
+	// False if nothing would look at the packet, so it needn't be unserialized
+	bool wanted(PacketID id)
+	{
+		if (!m_netclient.sig_incoming_packet.empty() || find_handlers(id))
+			return true;
+
+		// Handled here, or by the send filter
+		if (id == srv::Connection_Player::id || id == srv::Init_Init::id
+		 || id == srv::Welcome_Reply::id || id == srv::Warp_Agree::id || id == srv::Refresh_Reply::id)
+			return true;
+
+		if (m_ping_probes.empty())
+			return false;
+
+		return id == srv::Message_Pong::id
+		    || (m_ping_method == ping_find
+		     && (id == srv::Players_Ping::id || id == srv::Players_Pong::id || id == srv::Players_Net3::id));
 	}
 
 	void send_packet(PacketFamily family, PacketAction action,
 							Client_Packet& packet)
 	{
-		std::size_t size = packet.byte_size();
-		auto builder = std::make_shared<EO_Stream_Builder>(size + 4);
+		if (!m_send_filter.accept(packet))
+		{
+			trace_log("dropping redundant packet: " << name(family) << "_" << name(action));
+			m_telemetry.record_filtered({family, action});
+			return;
+		}
 
-		// Insert the packet size directly in to the builder
-		builder->add_short(size);
-		builder->add_byte(eo_byte(action));
-		builder->add_byte(eo_byte(family));
+		auto queued = Net_Telemetry::clock::now();
+		outgoing_t outgoing;
+		outgoing.id = {family, action};
+		outgoing.queued = queued;
 
-		trace_log("sending packet: " << name(family) << "_" << name(action));
+		bool send_now = m_send_filter.submit(outgoing, packet, queued, m_filtered);
 
-		unsigned seq = next_seq();
+		for (auto&& filtered_id : m_filtered)
+		{
+			trace_log("dropping superseded packet: " << name(filtered_id.first) << "_" << name(filtered_id.second));
+			m_telemetry.record_filtered(filtered_id);
+		}
 
-		if (family != PacketFamily::Init || action != PacketAction::Init)
+		m_filtered.clear();
+
+		if (send_now)
 		{
-			// TODO: builder.add_var(seq, 1, 2);
-			if (seq > 254)
-				builder->add_short(seq);
-			else
-				builder->add_char(seq);
+			outgoing.serialize(packet);
+			queue_outgoing(std::move(outgoing));
 		}
+		else
+		{
+			release_held();
+		}
+	}
 
-		packet.serialize(*builder);
+	void queue_outgoing(outgoing_t&& outgoing)
+	{
+		auto [family, action] = outgoing.id;
+		lane_t lane = m_family_lanes[eo_byte(family)];
 
-		trace_log("dump " << *builder);
+		trace_log("queueing packet: " << name(family) << "_" << name(action) << " in lane " << int(lane));
 
-		std::string& packet_data = builder->get();
+		m_send_lanes[lane].push_back(std::move(outgoing));
 
-		// Packet_Builder is happy to let you mutate it in-place
-		// Encode only the bytes of the packet after the length
-		m_processor.encode(&packet_data[2], packet_data.size() - 2);
+		if (!m_write_active)
+			do_write();
+	}
+
+	void release_held()
+	{
+		auto next = m_send_filter.release(Net_Telemetry::clock::now(), m_released);
+
+		for (auto&& outgoing : m_released)
+			queue_outgoing(std::move(outgoing));
+
+		m_released.clear();
+
+		if (next == Net_Telemetry::clock::time_point::max())
+			return;
+
+		m_release_timer.expires_at(next);
+		m_release_timer.async_wait([this](const asio::error_code& error)
+		{
+			if (error)
+				return;
+
+			release_held();
+		});
+	}
+
+	void do_write()
+	{
+		m_write_buffer.clear();
+
+		// Lanes are ordered by priority, and each is first-in first-out
+		while (m_write_buffer.size() < write_batch_size)
+		{
+			auto lane = std::find_if(m_send_lanes.begin(), m_send_lanes.end(),
+				[](const std::deque<outgoing_t>& lane) { return !lane.empty(); });
+
+			if (lane == m_send_lanes.end())
+				break;
+
+			append_frame(lane->front());
+			lane->pop_front();
+		}
+
+		m_write_active = !m_write_buffer.empty();
+
+		if (!m_write_active)
+			return;
 
-		// Important that the write handler captures builder by copy
 		asio::async_write(m_client,
-			asio::buffer(packet_data),
-			[this, builder](const asio::error_code& error, std::size_t bytes_transferred)
+			asio::buffer(m_write_buffer),
+			[this](const asio::error_code& error, std::size_t bytes_transferred)
 			{
 				if (error)
 				{
 					trace_log("write error: " << error.message());
+					m_write_active = false;
 					disconnect();
 					return;
 				}
+
+				do_write();
 			}
 		);
 	}
 
+	void append_frame(const outgoing_t& packet)
+	{
+		auto encode_start = Net_Telemetry::clock::now();
+		auto [family, action] = packet.id;
+
+		std::size_t offset = m_write_buffer.size();
+
+		// Length is filled in once the sequence number size is known
+		m_write_buffer.append(2, '\0');
+		m_write_buffer += char(action);
+		m_write_buffer += char(family);
+
+		trace_log("sending packet: " << name(family) << "_" << name(action));
+
+		// Assigned here rather than when queued so they follow the order packets are written
+		unsigned seq = next_seq();
+
+		if (family != PacketFamily::Init || action != PacketAction::Init)
+		{
+			auto encoded_seq = eo_encode_number(seq);
+			m_write_buffer += char(encoded_seq[0]);
+
+			if (seq > 254)
+				m_write_buffer += char(encoded_seq[1]);
+		}
+
+		m_write_buffer += packet.body;
+
+		char* frame = &m_write_buffer[offset];
+		std::size_t frame_size = m_write_buffer.size() - offset;
+
+		// The length does not cover itself
+		auto length = eo_encode_number(unsigned(frame_size - 2));
+		frame[0] = char(length[0]);
+		frame[1] = char(length[1]);
+
+		trace_log("dump " << hex_dump{std::string_view(frame, frame_size)});
+
+		// Encode only the bytes of the packet after the length
+		m_processor.encode(frame + 2, frame_size - 2);
+
+		m_telemetry.record(Net_Telemetry::outgoing, packet.id, frame_size,
+		                   packet.serialize_time + (Net_Telemetry::clock::now() - encode_start),
+		                   encode_start - packet.queued);
+
+		m_capture.record(Net_Capture::frame_out, {{frame, frame_size}});
+	}
+
 	void handle_ping(const srv::Connection_Player& packet)
 	{
 		m_seq_start = packet.seq_start();
+		m_capture.record_seq(m_seq_start);
 
 		cli::Connection_Ping ping_reply;
 		send_packet(ping_reply.family, ping_reply.action, ping_reply);
 	}
 
-	impl_t(NetClient& netclient)
+	void schedule_ping()
+	{
+		if (m_ping_interval.count() <= 0 || m_state != ready)
+			return;
+
+		m_ping_timer.expires_after(m_ping_interval);
+		m_ping_timer.async_wait([this](const asio::error_code& error)
+		{
+			if (error)
+				return;
+
+			send_ping();
+			schedule_ping();
+		});
+	}
+
+	void cancel_ping()
+	{
+		m_ping_timer.cancel();
+		m_ping_probes.clear();
+	}
+
+	void send_ping()
+	{
+		if (m_ping_probes.size() >= max_ping_probes)
+		{
+			trace_log("latency probe lost");
+			m_ping_probes.pop_front();
+		}
+
+		// Tokens are kept clear of the value sent by the official client's #ping
+		m_ping_token = eo_short(m_ping_token % 64000 + 1);
+
+		if (m_ping_token == 2)
+			++m_ping_token;
+
+		m_ping_probes.push_back({m_ping_token, Net_Telemetry::clock::now()});
+
+		if (m_ping_method == ping_find)
+		{
+			cli::Players_Accept ping;
+			ping.name = m_ping_find_name;
+			send_packet(ping.family, ping.action, ping);
+		}
+		else
+		{
+			cli::Message_Ping ping;
+			ping.something = m_ping_token;
+			send_packet(ping.family, ping.action, ping);
+		}
+	}
+
+	// Returns true if the packet answered a latency probe and should be consumed
+	bool handle_pong(const Server_Packet& packet, Net_Telemetry::clock::time_point arrival)
+	{
+		auto packet_id = packet.vid();
+
+		auto it = m_ping_probes.end();
+
+		if (packet_id == srv::Message_Pong::id)
+		{
+			auto token = packet.as<srv::Message_Pong>().something;
+
+			it = std::find_if(m_ping_probes.begin(), m_ping_probes.end(),
+				[token](const ping_probe_t& probe) { return probe.token == token; });
+		}
+		else if (m_ping_method == ping_find)
+		{
+			const std::string* reply_name = nullptr;
+
+			if (packet_id == srv::Players_Ping::id)
+				reply_name = &packet.as<srv::Players_Ping>().name;
+			else if (packet_id == srv::Players_Pong::id)
+				reply_name = &packet.as<srv::Players_Pong>().name;
+			else if (packet_id == srv::Players_Net3::id)
+				reply_name = &packet.as<srv::Players_Net3>().name;
+
+			// #find replies carry no token, but arrive in request order
+			// Replies for other names are the player's own searches and are left alone
+			if (reply_name && same_name(*reply_name, m_ping_find_name))
+				it = m_ping_probes.begin();
+		}
+
+		if (it == m_ping_probes.end())
+			return false;
+
+		m_telemetry.record_rtt(arrival - it->sent);
+		m_ping_probes.erase(m_ping_probes.begin(), std::next(it));
+
+		return true;
+	}
+
+	void release_read_buffer()
+	{
+		if (m_client_read_buffer.capacity() > read_buffer_keep)
+			std::vector<char>().swap(m_client_read_buffer);
+	}
+
+	impl_t(NetClient& netclient, std::unique_ptr<asio::io_context> owned_io_ctx,
+	       asio::io_context& io_ctx)
 		: m_netclient(netclient)
-		, m_client(m_io_ctx)
-	{ }
+		, m_owned_io_ctx(std::move(owned_io_ctx))
+		, m_strand(asio::make_strand(io_ctx))
+		, m_resolver(m_strand)
+		, m_client(m_strand)
+		, m_ping_timer(m_strand)
+		, m_release_timer(m_strand)
+	{
+		m_family_lanes.fill(lane_normal);
+
+		for (auto family : {PacketFamily::Walk, PacketFamily::Face, PacketFamily::Attack,
+		                    PacketFamily::Spell, PacketFamily::Cast})
+			m_family_lanes[eo_byte(family)] = lane_input;
+
+		// Latency probes go here too, so they measure what chat would see
+		for (auto family : {PacketFamily::Talk, PacketFamily::Global, PacketFamily::Message,
+		                    PacketFamily::Board, PacketFamily::Guild, PacketFamily::Players})
+			m_family_lanes[eo_byte(family)] = lane_bulk;
+	}
 };
 
 NetClient::NetClient()
-	: m_impl(std::make_unique<impl_t>(*this))
+{
+	auto io_ctx = std::make_unique<asio::io_context>();
+	auto&& io_ctx_ref = *io_ctx;
+
+	m_impl = std::make_unique<impl_t>(*this, std::move(io_ctx), io_ctx_ref);
+}
+
+NetClient::NetClient(asio::io_context& io_ctx)
+	: m_impl(std::make_unique<impl_t>(*this, nullptr, io_ctx))
 { }
 
 NetClient::~NetClient()
@@ -308,12 +938,65 @@ NetClient::~NetClient()
 
 void NetClient::connect(std::string_view host, std::string_view port)
 {
-	m_impl->connect(host, port);
+	asio::dispatch(m_impl->m_strand,
+		[impl = m_impl.get(), host = std::string(host), port = std::string(port)]()
+		{
+			impl->connect(host, port);
+		}
+	);
 }
 
 void NetClient::disconnect()
 {
-	m_impl->disconnect();
+	asio::dispatch(m_impl->m_strand, [impl = m_impl.get()]() { impl->disconnect(); });
+}
+
+void NetClient::dispatch(std::function<void()> fn)
+{
+	asio::dispatch(m_impl->m_strand, std::move(fn));
+}
+
+void NetClient::poll()
+{
+	auto&& io_ctx = m_impl->m_owned_io_ctx;
+
+	if (!io_ctx)
+		return;
+
+	if (io_ctx->stopped())
+		io_ctx->restart();
+
+	io_ctx->poll();
+
+	m_impl->dispatch_incoming();
+}
+
+void NetClient::set_file_sink(std::shared_ptr<Net_File_Sink> sink)
+{
+	asio::dispatch(m_impl->m_strand, [impl = m_impl.get(), sink = std::move(sink)]() mutable
+	{
+		impl->m_file_sink = std::move(sink);
+	});
+}
+
+util::connection NetClient::subscribe(PacketID id, util::function<void(Server_Packet&)> fn)
+{
+	return m_impl->subscribe(id, std::move(fn));
+}
+
+void NetClient::deliver(Server_Packet& packet)
+{
+	m_impl->deliver(packet);
+}
+
+Net_Coalescer& NetClient::coalescer()
+{
+	return m_impl->m_coalescer;
+}
+
+Net_Send_Filter& NetClient::send_filter()
+{
+	return m_impl->m_send_filter;
 }
 
 void NetClient::send_packet(PacketFamily family, PacketAction action,
@@ -321,3 +1004,64 @@ void NetClient::send_packet(PacketFamily family, PacketAction action,
 {
 	m_impl->send_packet(family, action, packet);
 }
+
+void NetClient::set_lane(PacketFamily family, lane_t lane)
+{
+	asio::dispatch(m_impl->m_strand, [impl = m_impl.get(), family, lane]()
+	{
+		impl->m_family_lanes[eo_byte(family)] = lane;
+	});
+}
+
+void NetClient::set_ping_interval(std::chrono::milliseconds interval,
+                                  ping_method_t method, std::string find_name)
+{
+	asio::dispatch(m_impl->m_strand,
+		[impl = m_impl.get(), interval, method, find_name = std::move(find_name)]() mutable
+		{
+			impl->m_ping_interval = interval;
+			impl->m_ping_method = method;
+			impl->m_ping_find_name = std::move(find_name);
+
+			impl->cancel_ping();
+			impl->schedule_ping();
+		}
+	);
+}
+
+bool NetClient::start_capture(const std::string& filename)
+{
+	auto&& impl = *m_impl;
+
+	if (!impl.m_capture.start(filename))
+		return false;
+
+	// Starting mid-session, so record the state needed to decode what follows
+	if (impl.m_processor.ready())
+	{
+		impl.m_capture.record_multi(impl.m_processor.multi_d(), impl.m_processor.multi_e());
+		impl.m_capture.record_seq(impl.m_seq_start);
+	}
+
+	return true;
+}
+
+void NetClient::stop_capture()
+{
+	m_impl->m_capture.stop();
+}
+
+Net_Telemetry::Snapshot NetClient::telemetry() const
+{
+	return m_impl->m_telemetry.snapshot();
+}
+
+Net_Telemetry::Latency NetClient::latency() const
+{
+	return m_impl->m_telemetry.latency();
+}
+
+void NetClient::reset_telemetry()
+{
+	m_impl->m_telemetry.reset();
+}
@@ -1,13 +1,26 @@
 #ifndef EO_NETCLIENT_HPP
 #define EO_NETCLIENT_HPP
 
+#include "net_telemetry.hpp"
 #include "packet/eo_packets.hpp"
 
 #include "util/signal.hpp"
 
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
 #include <string_view>
 
+namespace asio
+{
+	class io_context;
+}
+
+class Net_Coalescer;
+class Net_File_Sink;
+class Net_Send_Filter;
+
 class NetClient
 {
 	public:
@@ -19,15 +32,46 @@ class NetClient
 			ready
 		};
 
+		enum ping_method_t
+		{
+			// Message_Ping, answered with Message_Pong
+			ping_message,
+			// Players_Accept (#find), answered with Players_Ping/Pong/Net3
+			ping_find
+		};
+
+		// Outgoing packets wait in one of these while a write is in progress
+		// Lower lanes are only sent once the ones above them are empty
+		enum lane_t
+		{
+			// Walk, Face, Attack, Spell and Cast
+			lane_input,
+			lane_normal,
+			// Talk, Global, Message, Board, Guild and Players
+			lane_bulk,
+			lane_count
+		};
+
 		util::signal<void(state_t)> sig_state_change;
+
+		// Every packet, after its handlers from on()
+		// While this has slots every packet has to be unserialized
 		util::signal<void(Server_Packet&)> sig_incoming_packet;
 
 	private:
 		class impl_t;
 		std::unique_ptr<impl_t> m_impl;
 
+		util::connection subscribe(PacketID id, util::function<void(Server_Packet&)> fn);
+
 	public:
+		// Owns an io_context, driven by poll()
 		NetClient();
+
+		// Shares an io_context which may be run by several threads
+		// Packets must then be sent from the session's own handlers or dispatch()
+		explicit NetClient(asio::io_context& io_ctx);
+
 		~NetClient();
 
 		// no copy/move/assign
@@ -37,6 +81,39 @@ class NetClient
 		void connect(std::string_view host, std::string_view port);
 		void disconnect();
 
+		// Runs any pending network handlers without blocking, then delivers
+		// the packets they received with superseded ones dropped
+		// Does nothing when sharing an io_context
+		void poll();
+
+		// Runs fn serialized with this session's network handlers
+		void dispatch(std::function<void()> fn);
+
+		// Calls fn(const T&) with every received packet of type T, subscribe before connect()
+		// The returned connection can be used to unsubscribe from the same thread
+		// Types with no handlers are skipped without being unserialized
+		template <class T, class F>
+		util::connection on(F&& fn)
+		{
+			return subscribe(T::id, [fn = std::forward<F>(fn)](Server_Packet& packet)
+			{
+				fn(packet.template as<T>());
+			});
+		}
+
+		// Passes a packet to its handlers as if it had been received
+		void deliver(Server_Packet& packet);
+
+		// Rules for dropping superseded packets, change before connect()
+		Net_Coalescer& coalescer();
+
+		// Rules for holding back and dropping redundant actions, change before connect()
+		Net_Send_Filter& send_filter();
+
+		// Large Init_Init file replies are passed to sink as they arrive rather than buffered
+		// The Init_Init packet is still delivered afterwards, with empty content
+		void set_file_sink(std::shared_ptr<Net_File_Sink> sink);
+
 		void send_packet(PacketFamily family, PacketAction action,
 		                 Client_Packet& packet);
 
@@ -45,6 +122,25 @@ class NetClient
 		{
 			send_packet(T::family, T::action, packet);
 		}
+
+		// Moves every packet of a family to another lane
+		void set_lane(PacketFamily family, lane_t lane);
+
+		// Sends a latency probe every interval while ready, zero disables
+		// ping_find requires the name of a character to search for
+		void set_ping_interval(std::chrono::milliseconds interval,
+		                       ping_method_t method = ping_message,
+		                       std::string find_name = {});
+
+		// Records raw frames and encryption state changes to a capture file
+		// See net_capture.hpp for the file format
+		bool start_capture(const std::string& filename);
+		void stop_capture();
+
+		// Per-packet-type counters, safe to call from any thread
+		Net_Telemetry::Snapshot telemetry() const;
+		Net_Telemetry::Latency latency() const;
+		void reset_telemetry();
 };
 
 #endif // EO_NETCLIENT_HPP
@@ -75,7 +75,7 @@ const char* name(PacketFamily family)
 	{
 		return "Init";
 	}
-	else if (eo_byte(family) > std::extent_v<decltype(family_names)>)
+	else if (eo_byte(family) >= std::extent_v<decltype(family_names)>)
 	{
 		std::snprintf(family_name_buf, sizeof family_name_buf, "%d", eo_byte(family));
 		return family_name_buf;
@@ -92,9 +92,21 @@ const char* name(PacketAction action)
 	{
 		return "Init";
 	}
-	else if (eo_byte(action) > std::extent_v<decltype(action_names)>)
+	else if (action == PacketAction::Ping)
 	{
-		std::snprintf(family_name_buf, sizeof family_name_buf, "%d", eo_byte(action));
+		return "Ping";
+	}
+	else if (action == PacketAction::Pong)
+	{
+		return "Pong";
+	}
+	else if (action == PacketAction::Net3)
+	{
+		return "Net3";
+	}
+	else if (eo_byte(action) >= std::extent_v<decltype(action_names)>)
+	{
+		std::snprintf(action_name_buf, sizeof action_name_buf, "%d", eo_byte(action));
 		return action_name_buf;
 	}
 	else
@@ -1,8 +1,11 @@
 #include "packet_processor.hpp"
 
-#include "cio/cio.hpp" // debug
+#ifdef EOREF_PACKET_DUMP
+#include "cio/cio.hpp"
+#endif
 
 #include <utility>
+#include <vector>
 
 namespace eo_protocol
 {
@@ -43,11 +46,20 @@ void Packet_Processor::swap_multiples(char* buf, std::size_t n, eo_byte multi)
 		swap_f(n - sequence_length, sequence_length);
 }
 
-Packet_Processor::Packet_Processor()
+// Scratch space shared by every processor on a thread, sessions only keep their multipliers
+static std::vector<char>& scratch_buffer(std::size_t n)
 {
-	m_buf.resize(2048);
+	thread_local std::vector<char> buf(2048);
+
+	if (buf.size() < n)
+		buf.resize(n);
+
+	return buf;
 }
 
+Packet_Processor::Packet_Processor()
+{ }
+
 void Packet_Processor::decode(char* buf, std::size_t n)
 {
 	if (!ready())
@@ -56,27 +68,28 @@ void Packet_Processor::decode(char* buf, std::size_t n)
 	if (eo_byte(buf[0]) == 0xFF && eo_byte(buf[1]) == 0xFF)
 		return;
 
-	if (m_buf.size() < n)
-		m_buf.resize(n);
+	auto&& scratch = scratch_buffer(n);
 
+#ifdef EOREF_PACKET_DUMP
 	cio::err << "RecvE: ";
 
 	for (std::size_t i = 0; i < n; ++i)
 		cio::err << unsigned(eo_byte(buf[i])) << ' ';
 
 	cio::err << cio::endl;
+#endif
 
 	std::size_t big_half = ((n + 1) / 2);
 	std::size_t little_half = (n / 2);
 
 	for (std::size_t i = 0; i < big_half; ++i)
-		m_buf[i] = buf[i * 2];
+		scratch[i] = buf[i * 2];
 
 	for (std::size_t i = 0; i < little_half; ++i)
-		m_buf[n - 1 - i] = buf[(i * 2) + 1];
+		scratch[n - 1 - i] = buf[(i * 2) + 1];
 
 	for (std::size_t i = 0; i < n; ++i)
-		buf[i] = eo_byte(m_buf[i]) ^ 0x80;
+		buf[i] = eo_byte(scratch[i]) ^ 0x80;
 
 	for (std::size_t i = 0; i < n; ++i)
 	{
@@ -86,12 +99,14 @@ void Packet_Processor::decode(char* buf, std::size_t n)
 			buf[i] = 0;
 	}
 
+#ifdef EOREF_PACKET_DUMP
 	cio::err << "Recv : ";
 
 	for (std::size_t i = 0; i < n; ++i)
 		cio::err << unsigned(eo_byte(buf[i])) << ' ';
 
 	cio::err << cio::endl;
+#endif
 
 	swap_multiples(buf, n, m_multi_d);
 }
@@ -104,15 +119,16 @@ void Packet_Processor::encode(char* buf, std::size_t n)
 	if (eo_byte(buf[0]) == 0xFF && eo_byte(buf[1]) == 0xFF)
 		return;
 
-	if (m_buf.size() < n)
-		m_buf.resize(n);
+	auto&& scratch = scratch_buffer(n);
 
+#ifdef EOREF_PACKET_DUMP
 	cio::err << "Send : ";
 
 	for (std::size_t i = 0; i < n; ++i)
 		cio::err << unsigned(eo_byte(buf[i])) << ' ';
 
 	cio::err << cio::endl;
+#endif
 
 	swap_multiples(buf, n, m_multi_e);
 
@@ -128,20 +144,22 @@ void Packet_Processor::encode(char* buf, std::size_t n)
 	std::size_t little_half = (n / 2);
 
 	for (std::size_t i = 0; i < big_half; ++i)
-		m_buf[i * 2] = buf[i];
+		scratch[i * 2] = buf[i];
 
 	for (std::size_t i = 0; i < little_half; ++i)
-		m_buf[(i * 2) + 1] = buf[n - 1 - i];
+		scratch[(i * 2) + 1] = buf[n - 1 - i];
 
 	for (std::size_t i = 0; i < n; ++i)
-		buf[i] = eo_byte(m_buf[i]) ^ 0x80;
+		buf[i] = eo_byte(scratch[i]) ^ 0x80;
 
+#ifdef EOREF_PACKET_DUMP
 	cio::err << "SendE: ";
 
 	for (std::size_t i = 0; i < n; ++i)
 		cio::err << unsigned(eo_byte(buf[i])) << ' ';
 
 	cio::err << cio::endl;
+#endif
 }
 
 void Packet_Processor::set_multi(eo_byte d, eo_byte e)
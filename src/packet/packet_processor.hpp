@@ -3,14 +3,11 @@
 
 #include "packet_base.hpp"
 
-#include <vector>
-
 namespace eo_protocol
 {
 	class Packet_Processor
 	{
 		private:
-			std::vector<char> m_buf;
 			eo_byte m_multi_d = 0;
 			eo_byte m_multi_e = 0;
 
@@ -24,6 +21,9 @@ namespace eo_protocol
 
 			void set_multi(eo_byte d, eo_byte e);
 
+			eo_byte multi_d() const { return m_multi_d; }
+			eo_byte multi_e() const { return m_multi_e; }
+
 			bool ready() const;
 	};
 }
@@ -2,10 +2,11 @@
 #define EO_TRACE_HPP
 
 //#ifdef ENABLE_TRACE
+#ifndef EOREF_NO_TRACE
 #include "cio/cio.hpp"
 #define trace_log(printer) cio::out << '[' << TRACE_CTX << ':' << __func__ << ']' << ' ' << printer << cio::endl
-//#else
-//#define trace_log(printer)
-//#endif
+#else
+#define trace_log(printer) do { } while (0)
+#endif
 
 #endif // EO_TRACE_HPP
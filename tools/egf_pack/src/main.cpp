@@ -0,0 +1,460 @@
+// Decodes every graphic in a directory of EGF files in to one archive,
+// which the client maps and uploads from without touching the EGFs' bitmaps.
+// See src/data/gfx_archive.hpp for the layout.
+
+#include "data/dib_reader.hpp"
+#include "data/egf_index.hpp"
+#include "data/gfx_archive.hpp"
+#include "data/pe_reader.hpp"
+
+#include "cio/cio.hpp"
+#include "cio/mapped_file.hpp"
+#include "util/hash.hpp"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+static constexpr int EGF_MAX = 25;
+
+// Space left around each opaque box in the atlas, so filtering doesn't bleed between images
+static constexpr int atlas_padding = 1;
+
+struct Packed_Image
+{
+	int egf_id;
+	int id;
+	int width;
+	int height;
+
+	GFX_Archive::Rect opaque;
+
+	std::uint32_t atlas_page = GFX_Archive::no_page;
+	int atlas_x = 0;
+	int atlas_y = 0;
+
+	std::uint64_t offset = 0;
+
+	// Index of an earlier image with the same bitmap, whose pixels and atlas space this one shares
+	int first_copy = -1;
+};
+
+struct EGF_File
+{
+	int id;
+	cio::mapped_file file;
+	pe_reader pe;
+	pe_reader::Bitmap_Table table;
+};
+
+static void append_u32_le(std::vector<char>& buf, std::uint32_t n)
+{
+	for (int i = 0; i < 4; ++i)
+		buf.push_back(char((n >> (i * 8)) & 0xFF));
+}
+
+static void append_u64_le(std::vector<char>& buf, std::uint64_t n)
+{
+	for (int i = 0; i < 8; ++i)
+		buf.push_back(char((n >> (i * 8)) & 0xFF));
+}
+
+static GFX_Archive::Rect opaque_box(const std::vector<char>& pixels, int width, int height)
+{
+	int x1 = width, y1 = height, x2 = -1, y2 = -1;
+
+	for (int y = 0; y < height; ++y)
+	{
+		const char* row = &pixels[std::size_t(y) * width * 4];
+
+		for (int x = 0; x < width; ++x)
+		{
+			if (row[x * 4 + 3] == 0)
+				continue;
+
+			x1 = std::min(x1, x);
+			x2 = std::max(x2, x);
+			y1 = std::min(y1, y);
+			y2 = std::max(y2, y);
+		}
+	}
+
+	if (x2 < 0)
+		return {};
+
+	return {x1, y1, x2 - x1 + 1, y2 - y1 + 1};
+}
+
+// Shelf packing, tallest first
+static int pack_atlas(std::vector<Packed_Image>& images, int page_size)
+{
+	struct Shelf
+	{
+		std::uint32_t page;
+		int y;
+		int height;
+		int x;
+	};
+
+	std::vector<Packed_Image*> order;
+
+	for (auto&& image : images)
+	{
+		int w = image.opaque.width + atlas_padding;
+		int h = image.opaque.height + atlas_padding;
+
+		if (image.first_copy < 0 && image.opaque.width > 0 && w <= page_size && h <= page_size)
+			order.push_back(&image);
+	}
+
+	std::stable_sort(order.begin(), order.end(), [](const Packed_Image* a, const Packed_Image* b)
+	{
+		return a->opaque.height > b->opaque.height;
+	});
+
+	std::vector<Shelf> shelves;
+	std::vector<int> page_heights;
+
+	for (auto image : order)
+	{
+		int w = image->opaque.width + atlas_padding;
+		int h = image->opaque.height + atlas_padding;
+
+		auto shelf = std::find_if(shelves.begin(), shelves.end(), [&](const Shelf& shelf)
+		{
+			return shelf.height >= h && shelf.x + w <= page_size;
+		});
+
+		if (shelf == shelves.end())
+		{
+			auto page = std::find_if(page_heights.begin(), page_heights.end(),
+				[&](int used) { return used + h <= page_size; });
+
+			if (page == page_heights.end())
+			{
+				page_heights.push_back(0);
+				page = page_heights.end() - 1;
+			}
+
+			shelves.push_back({std::uint32_t(page - page_heights.begin()), *page, h, 0});
+			*page += h;
+			shelf = shelves.end() - 1;
+		}
+
+		image->atlas_page = shelf->page;
+		image->atlas_x = shelf->x;
+		image->atlas_y = shelf->y;
+
+		shelf->x += w;
+	}
+
+	for (auto&& image : images)
+	{
+		if (image.first_copy < 0)
+			continue;
+
+		auto&& first = images[image.first_copy];
+		image.atlas_page = first.atlas_page;
+		image.atlas_x = first.atlas_x;
+		image.atlas_y = first.atlas_y;
+	}
+
+	return int(page_heights.size());
+}
+
+static void usage()
+{
+	std::fputs("usage: egf_pack [-format rgba|bgra] [-key RRGGBB|none] [-page N] gfx_dir output\n", stderr);
+}
+
+int main(int argc, char** argv)
+{
+	const char* gfx_dir = nullptr;
+	const char* output_filename = nullptr;
+
+	// bgra matches ALLEGRO_PIXEL_FORMAT_ARGB_8888, which display bitmaps use on little-endian systems
+	Pixel_Format format = Pixel_Format::bgra;
+
+	// Black is transparent in EGF graphics
+	bool use_key = true;
+	std::uint32_t key = 0x000000;
+
+	int page_size = 2048;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+
+		if (std::strcmp(arg, "-format") == 0 && i + 1 < argc)
+		{
+			const char* value = argv[++i];
+
+			if (std::strcmp(value, "rgba") == 0)
+				format = Pixel_Format::rgba;
+			else if (std::strcmp(value, "bgra") == 0)
+				format = Pixel_Format::bgra;
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+		else if (std::strcmp(arg, "-key") == 0 && i + 1 < argc)
+		{
+			const char* value = argv[++i];
+
+			use_key = (std::strcmp(value, "none") != 0);
+
+			if (use_key)
+			{
+				std::size_t length = std::strlen(value);
+				auto result = std::from_chars(value, value + length, key, 16);
+
+				if (length != 6 || result.ec != std::errc{} || result.ptr != value + length)
+				{
+					usage();
+					return 1;
+				}
+			}
+		}
+		else if (std::strcmp(arg, "-page") == 0 && i + 1 < argc)
+		{
+			page_size = std::max(64, std::atoi(argv[++i]));
+		}
+		else if (arg[0] != '-' && !gfx_dir)
+		{
+			gfx_dir = arg;
+		}
+		else if (arg[0] != '-' && !output_filename)
+		{
+			output_filename = arg;
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	if (!gfx_dir || !output_filename)
+	{
+		usage();
+		return 1;
+	}
+
+	std::vector<std::unique_ptr<EGF_File>> egfs;
+	std::vector<GFX_Archive::Source> sources;
+	std::vector<Packed_Image> images;
+	std::size_t unsupported = 0;
+
+	for (int id = 1; id <= EGF_MAX; ++id)
+	{
+		auto egf = std::make_unique<EGF_File>();
+		auto filename = fmt::format("{}/gfx{:03}.egf", gfx_dir, id);
+
+		egf->id = id;
+
+		if (!egf->file.open(filename.c_str()))
+			continue;
+
+		egf->pe = pe_reader(egf->file.view());
+
+		if (!egf->pe.read_header())
+		{
+			fmt::print(stderr, "{} is not a PE file\n", filename);
+			continue;
+		}
+
+		egf->table = egf->pe.read_bitmap_table();
+
+		sources.push_back({id, egf->file.size(), EGF_Index::header_hash(egf->file.view())});
+
+		// Formats the decoder can't handle are left to the client's fallback loader
+		for (auto&& info : egf->table)
+		{
+			auto dib = egf->pe.resource(info.start, info.size);
+
+			if (dib.size() < 40)
+				continue;
+
+			dib_reader reader(dib.data(), dib.size());
+			reader.start();
+
+			int width = reader.width();
+			int height = std::abs(reader.height());
+
+			if (reader.check_format() || width <= 0 || width > 0xFFFF || height <= 0 || height > 0xFFFF)
+			{
+				++unsupported;
+				continue;
+			}
+
+			images.push_back({id, info.id, width, height, {}});
+		}
+
+		egfs.push_back(std::move(egf));
+	}
+
+	std::uint64_t table_end = GFX_Archive::header_size
+	                        + sources.size() * GFX_Archive::source_size
+	                        + images.size() * GFX_Archive::image_size;
+
+	auto part_filename = std::string(output_filename) + ".part";
+	cio::stream out(part_filename.c_str(), cio::stream::mode_write);
+
+	if (!out)
+	{
+		std::perror("Could not open output file");
+		return 1;
+	}
+
+	// Pixels are written as each image is decoded, the tables once the atlas is known
+	std::vector<char> zeros(std::size_t(table_end), '\0');
+	std::uint64_t offset = table_end;
+	bool write_failed = (out.write(zeros.data(), zeros.size()) != zeros.size());
+
+	std::vector<char> pixels;
+	std::uint64_t pixel_bytes = 0;
+	std::size_t duplicates = 0;
+
+	// Bitmaps already written, by content hash
+	std::unordered_map<std::uint64_t, std::pair<int, std::string_view>> written;
+
+	auto egf_it = egfs.begin();
+
+	for (int i = 0; i < int(images.size()); ++i)
+	{
+		auto&& image = images[i];
+
+		while ((*egf_it)->id != image.egf_id)
+			++egf_it;
+
+		auto&& egf = **egf_it;
+		auto info = pe_reader::find(egf.table, image.id);
+		auto dib = egf.pe.resource(info->start, info->size);
+
+		auto first = written.insert({util::fnv1a_64(dib), {i, dib}});
+
+		if (!first.second && first.first->second.second == dib)
+		{
+			auto&& first_image = images[first.first->second.first];
+			image.first_copy = first.first->second.first;
+			image.opaque = first_image.opaque;
+			image.offset = first_image.offset;
+			++duplicates;
+			continue;
+		}
+
+		dib_reader reader(dib.data(), dib.size());
+		reader.start();
+
+		if (use_key)
+			reader.set_color_key(key);
+
+		std::size_t line_size = std::size_t(image.width) * 4;
+		pixels.resize(line_size * image.height);
+
+		reader.read_image(pixels.data(), std::ptrdiff_t(line_size), format);
+
+		image.opaque = opaque_box(pixels, image.width, image.height);
+
+		std::size_t padding = (GFX_Archive::pixel_alignment - offset % GFX_Archive::pixel_alignment)
+		                    % GFX_Archive::pixel_alignment;
+
+		if (padding > 0)
+			write_failed |= (out.write(zeros.data(), padding) != padding);
+
+		offset += padding;
+		image.offset = offset;
+
+		write_failed |= (out.write(pixels.data(), pixels.size()) != pixels.size());
+		offset += pixels.size();
+		pixel_bytes += pixels.size();
+	}
+
+	int page_count = pack_atlas(images, page_size);
+
+	std::vector<char> tables(std::begin(GFX_Archive::magic), std::end(GFX_Archive::magic));
+	append_u32_le(tables, GFX_Archive::version);
+	append_u32_le(tables, std::uint32_t(format));
+	append_u32_le(tables, std::uint32_t(page_size));
+	append_u32_le(tables, std::uint32_t(page_count));
+	append_u32_le(tables, std::uint32_t(sources.size()));
+	append_u32_le(tables, std::uint32_t(images.size()));
+	append_u32_le(tables, use_key ? key : GFX_Archive::no_key);
+
+	for (auto&& source : sources)
+	{
+		append_u32_le(tables, std::uint32_t(source.egf_id));
+		append_u32_le(tables, 0);
+		append_u64_le(tables, source.size);
+		append_u64_le(tables, source.hash);
+	}
+
+	for (auto&& image : images)
+	{
+		append_u32_le(tables, std::uint32_t(image.egf_id));
+		append_u32_le(tables, std::uint32_t(image.id));
+		append_u32_le(tables, std::uint32_t(image.width));
+		append_u32_le(tables, std::uint32_t(image.height));
+		append_u32_le(tables, std::uint32_t(image.opaque.x));
+		append_u32_le(tables, std::uint32_t(image.opaque.y));
+		append_u32_le(tables, std::uint32_t(image.opaque.width));
+		append_u32_le(tables, std::uint32_t(image.opaque.height));
+		append_u32_le(tables, image.atlas_page);
+		append_u32_le(tables, std::uint32_t(image.atlas_x));
+		append_u32_le(tables, std::uint32_t(image.atlas_y));
+		append_u32_le(tables, 0);
+		append_u64_le(tables, image.offset);
+	}
+
+	if (!out.seek(0))
+		write_failed = true;
+	else
+		write_failed |= (out.write(tables.data(), tables.size()) != tables.size());
+
+	out.close();
+
+	if (write_failed)
+	{
+		std::fputs("Could not write output file\n", stderr);
+		std::remove(part_filename.c_str());
+		return 1;
+	}
+
+#ifdef _WIN32
+	// rename() won't replace an existing file here, elsewhere it replaces it atomically
+	std::remove(output_filename);
+#endif // _WIN32
+
+	if (std::rename(part_filename.c_str(), output_filename) != 0)
+	{
+		std::perror("Could not move output file in to place");
+		return 1;
+	}
+
+	GFX_Archive archive;
+
+	if (!archive.open(output_filename) || archive.size() != images.size())
+	{
+		std::fputs("Output file failed to read back\n", stderr);
+		return 1;
+	}
+
+	fmt::print("{} EGF files, {} graphics, {} duplicates, {} unsupported\n", sources.size(), images.size(), duplicates, unsupported);
+	fmt::print("{:.1f} MB of pixels, {} atlas page(s) of {}x{}\n",
+		double(pixel_bytes) / (1024 * 1024), page_count, page_size, page_size);
+
+	return 0;
+}
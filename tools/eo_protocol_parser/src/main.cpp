@@ -160,6 +160,19 @@ static void write_client_packet_impls(std::ostream& f, const Printer& p)
 	f << std::endl;
 }
 
+// Reverse direction codec, only linked in to tools which act as a server
+static void write_client_packet_unserialize_impls(std::ostream& f, const Printer& p)
+{
+	f << autogen_comment << "\n";
+	f << "#include \"client.hpp\"\n\n";
+	write_includes(f, headers, struct_headers, packet_headers);
+	f << "namespace eo_protocol\n{\n";
+	f << "namespace client\n{\n\n\n";
+	p.print_client_packet_unserialize_impls(f);
+	f << "\n}\n}\n";
+	f << std::endl;
+}
+
 static void write_client_packet_tpp(std::ostream& f, const Printer& p)
 {
 	f << autogen_comment << "\n";
@@ -198,6 +211,19 @@ static void write_server_packet_impls(std::ostream& f, const Printer& p)
 	f << std::endl;
 }
 
+// Reverse direction codec, only linked in to tools which act as a server
+static void write_server_packet_serialize_impls(std::ostream& f, const Printer& p)
+{
+	f << autogen_comment << "\n";
+	f << "#include \"server.hpp\"\n\n";
+	write_includes(f, headers, struct_headers, packet_headers);
+	f << "namespace eo_protocol\n{\n";
+	f << "namespace server\n{\n\n\n";
+	p.print_server_packet_serialize_impls(f);
+	f << "\n}\n}\n";
+	f << std::endl;
+}
+
 static void write_server_packet_tpp(std::ostream& f, const Printer& p)
 {
 	f << autogen_comment << "\n";
@@ -304,9 +330,11 @@ int main(int argc, char** argv)
 		{ "structs.cpp", write_struct_impls },
 		{ "client.hpp", write_client_packets },
 		{ "client.cpp", write_client_packet_impls },
+		{ "client_unserialize.cpp", write_client_packet_unserialize_impls },
 		{ "client_packets.tpp", write_client_packet_tpp },
 		{ "server.hpp", write_server_packets },
 		{ "server.cpp", write_server_packet_impls },
+		{ "server_serialize.cpp", write_server_packet_serialize_impls },
 		{ "server_packets.tpp", write_server_packet_tpp }
 	};
 
@@ -137,43 +137,53 @@ struct make_byte_size_visitor
 
 	void operator()(const std::shared_ptr<UnionBlock>& union_block)
 	{
-		int max_constant = 0;
+		auto enum_type = printer.get_enum_type(dbe, union_block->switch_field);
+		auto switch_field = prefix + union_block->switch_field;
 
+		for (auto& case_it : union_block->cases)
 		{
-			auto enum_type = printer.get_enum_type(dbe, union_block->switch_field);
+			auto& case_name = case_it.first;
+			auto& case_data = case_it.second;
+
+			int inner_constant = 0;
+			std::string inner_adds;
+
+			make_byte_size_visitor inner_size{printer, case_data->dbe, inner_constant,
+			                                  inner_adds, prefix + "u." + case_data->name + "."};
 
-			for (auto& case_it : union_block->cases)
+			for (auto& entry : case_data->dbe.entries)
 			{
-				auto& case_name = case_it.first;
-				auto& case_data = case_it.second;
+				visit(inner_size, entry);
+			}
 
-				int inner_constant = 0;
-				std::string inner_adds;
+			if (inner_constant == 0 && inner_adds.empty())
+				continue;
 
-				make_byte_size_visitor inner_size{printer, dbe, inner_constant,
-					                              inner_adds, "u." + case_data->name + "."};
+			std::string cond;
 
-				for (auto& entry : case_data->dbe.entries)
+			if (case_name == "default")
+			{
+				for (auto& other_it : union_block->cases)
 				{
-					visit(inner_size, entry);
-				}
+					if (other_it.first == "default")
+						continue;
 
-				if (!inner_adds.empty())
-				{
-					inner_adds = inner_adds.substr(7);
+					if (!cond.empty())
+						cond += " && ";
 
-					adds += "\n\t     + ("
-						  + union_block->switch_field + " == "
-					      + enum_type + "::" + case_name + " ? "
-						  + "(" + std::to_string(inner_constant) + inner_adds + ")"
-						  + " : 0)";
-				}
-				else
-				{
-					if (inner_constant > max_constant)
-						max_constant = inner_constant;
+					cond += switch_field + " != " + enum_type + "::" + other_it.first;
 				}
+
+				if (cond.empty())
+					cond = "true";
 			}
+			else
+			{
+				cond = switch_field + " == " + enum_type + "::" + case_name;
+			}
+
+			adds += "\n\t      + ((" + cond + ") ? ("
+			      + std::to_string(inner_constant) + inner_adds + ") : 0)";
 		}
 	}
 };
@@ -716,7 +726,8 @@ struct unserialize_print_visitor
 		else if (data_field->type_dynamic_size)
 			get = "get_fixed_string(" + prefix + data_field->type_dynamic_size.value() + ")";
 
-		if (printer.type_type(data_field->type) == Printer::type_enum)
+		// Fields with a type class are stored as their underlying type
+		if (printer.type_type(data_field->type) == Printer::type_enum && !data_field->type_class)
 		{
 			cast_begin = "static_cast<" + data_field->type + ">(";
 			cast_end = ")";
@@ -903,10 +914,14 @@ void Printer::print_client_def(std::ostream& os,
 	print_data_block(os, packet_data.dbe, depth + 1);
 
 	os << '\n'
+	   << tabs << "\t" << packet_name << "() = default;\n"
+	   << tabs << "\t" << packet_name << "(EO_Stream_Reader& reader) { unserialize(reader); }\n"
 	   << tabs << "\tvirtual ~" << packet_name << "() override final = default;\n"
 	   << tabs << "\tvirtual std::size_t byte_size() const override final;\n"
 	   << tabs << "\tvirtual void serialize(EO_Stream_Builder& builder) const override final;\n"
 	   << tabs << "\tvirtual PacketID vid() const override final;\n"
+	   << tabs << "\t// Server-side codec, see client_unserialize.cpp\n"
+	   << tabs << "\tvoid unserialize(EO_Stream_Reader& reader);\n"
 	   << tabs << "};\n";
 
 }
@@ -938,6 +953,9 @@ void Printer::print_server_def(std::ostream& os,
 	   << tabs << "\tvirtual ~" << packet_name << "() override final = default;\n"
 	   << tabs << "\tvirtual void unserialize(EO_Stream_Reader& reader) override final;\n"
 	   << tabs << "\tvirtual PacketID vid() const override final;\n"
+	   << tabs << "\t// Server-side codec, see server_serialize.cpp\n"
+	   << tabs << "\tstd::size_t byte_size() const;\n"
+	   << tabs << "\tvoid serialize(EO_Stream_Builder& builder) const;\n"
 	   << tabs << "};\n";
 }
 
@@ -990,6 +1008,45 @@ void Printer::print_server_impl(std::ostream& os,
 	   << tabs << "{ return id; }\n";
 }
 
+void Printer::print_client_unserialize_impl(std::ostream& os,
+                                            const std::pair<std::string, PacketBlock::ptr>& packet_it,
+                                            int depth) const
+{
+	auto tabs = make_tabs(depth);
+
+	auto& packet_name = packet_it.first;
+	auto& packet_data = *packet_it.second;
+
+	os << tabs << "void " << packet_name << "::unserialize(EO_Stream_Reader& reader)\n"
+	   << tabs << "{\n";
+
+	print_unserialize_code(os, packet_data.dbe, depth + 1);
+
+	os << tabs << "}\n";
+}
+
+void Printer::print_server_serialize_impl(std::ostream& os,
+                                          const std::pair<std::string, PacketBlock::ptr>& packet_it,
+                                          int depth) const
+{
+	auto tabs = make_tabs(depth);
+
+	auto& packet_name = packet_it.first;
+	auto& packet_data = *packet_it.second;
+
+	os << tabs << "std::size_t " << packet_name << "::byte_size() const\n"
+	   << tabs << "{\n"
+	   << tabs << "\treturn " << make_byte_size_expression(packet_data.dbe) << ";\n"
+	   << tabs << "}\n\n";
+
+	os << tabs << "void " << packet_name << "::serialize(EO_Stream_Builder& builder) const\n"
+	   << tabs << "{\n";
+
+	print_serialize_code(os, packet_data.dbe, depth + 1);
+
+	os << tabs << "}\n";
+}
+
 void Printer::print_enums(std::ostream& os, int depth) const
 {
 	for (auto& enum_it : make_sorted_by_key(m_proto.enums))
@@ -1197,3 +1254,21 @@ void Printer::print_server_packet_impls(std::ostream& os, int depth) const
 		os << "\n";
 	}
 }
+
+void Printer::print_client_packet_unserialize_impls(std::ostream& os, int depth) const
+{
+	for (auto& packet_it : make_sorted_by_key(m_proto.client_packets))
+	{
+		print_client_unserialize_impl(os, packet_it, depth);
+		os << "\n";
+	}
+}
+
+void Printer::print_server_packet_serialize_impls(std::ostream& os, int depth) const
+{
+	for (auto& packet_it : make_sorted_by_key(m_proto.server_packets))
+	{
+		print_server_serialize_impl(os, packet_it, depth);
+		os << "\n";
+	}
+}
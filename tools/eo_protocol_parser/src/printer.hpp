@@ -44,6 +44,8 @@ class Printer
 		void print_server_def(std::ostream&, const std::pair<std::string, PacketBlock::ptr>&, int depth = 0) const;
 		void print_client_impl(std::ostream&, const std::pair<std::string, PacketBlock::ptr>&, int depth = 0) const;
 		void print_server_impl(std::ostream&, const std::pair<std::string, PacketBlock::ptr>&, int depth = 0) const;
+		void print_client_unserialize_impl(std::ostream&, const std::pair<std::string, PacketBlock::ptr>&, int depth = 0) const;
+		void print_server_serialize_impl(std::ostream&, const std::pair<std::string, PacketBlock::ptr>&, int depth = 0) const;
 
 		void print_enums(std::ostream&, int depth = 0) const;
 		void print_structs(std::ostream&, int depth = 0) const;
@@ -57,6 +59,8 @@ class Printer
 		void print_server_packet_cases(std::ostream&, int depth = 0) const;
 		void print_client_packet_impls(std::ostream&, int depth = 0) const;
 		void print_server_packet_impls(std::ostream&, int depth = 0) const;
+		void print_client_packet_unserialize_impls(std::ostream&, int depth = 0) const;
+		void print_server_packet_serialize_impls(std::ostream&, int depth = 0) const;
 };
 
 #endif // PRINTER_HPP
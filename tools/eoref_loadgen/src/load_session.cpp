@@ -0,0 +1,274 @@
+#include "load_session.hpp"
+
+#include "packet/eo_packets.hpp"
+
+#include <algorithm>
+
+static Login_Sequence::Options login_options(const Load_Options& options, int index)
+{
+	Login_Sequence::Options result;
+	result.username = options.username_prefix + std::to_string(index);
+	result.password = options.password;
+	result.hdid = "eoref-loadgen";
+	return result;
+}
+
+Load_Session::Load_Session(asio::io_context& io_ctx, const Load_Options& options,
+                           Load_Stats& stats, int index)
+	: m_options(options)
+	, m_stats(stats)
+	, m_index(index)
+	, m_client(io_ctx)
+	, m_login(m_client, nullptr, login_options(options, index))
+	, m_timer(io_ctx)
+{
+	m_client.sig_state_change.connect([this](NetClient::state_t state)
+	{
+		handle_state(state);
+	});
+
+	// Only what the login needs is unserialized, the rest of the traffic is just counted
+	if (m_options.login)
+	{
+		m_client.on<srv::Init_Init>([this](const srv::Init_Init& init)
+		{
+			m_login.handle_packet(init);
+		});
+
+		m_client.on<srv::Login_Reply>([this](const srv::Login_Reply& reply)
+		{
+			m_login.handle_packet(reply);
+		});
+
+		m_client.on<srv::Welcome_Reply>([this](const srv::Welcome_Reply& reply)
+		{
+			handle_welcome(reply);
+		});
+	}
+
+	m_login.sig_complete.connect([this]()
+	{
+		enter_game();
+	});
+
+	m_login.sig_failed.connect([this](const char* reason)
+	{
+		fail(reason);
+	});
+
+	m_client.set_ping_interval(m_options.ping_interval);
+}
+
+void Load_Session::start()
+{
+	m_connect_time = clock::now();
+	m_stage = stage_connecting;
+
+	if (m_options.login)
+		m_login.start(m_options.host, m_options.port);
+	else
+		m_client.connect(m_options.host, m_options.port);
+}
+
+void Load_Session::stop()
+{
+	m_client.dispatch([this]()
+	{
+		m_stage = stage_done;
+		m_timer.cancel();
+		m_client.disconnect();
+	});
+}
+
+Net_Telemetry::Snapshot Load_Session::telemetry() const
+{
+	return m_client.telemetry();
+}
+
+void Load_Session::fail(const char* reason)
+{
+	if (m_stage == stage_done)
+		return;
+
+	m_stage = stage_done;
+	++m_stats.failed;
+	m_stats.last_failure = reason;
+
+	m_client.disconnect();
+}
+
+void Load_Session::handle_state(NetClient::state_t state)
+{
+	switch (state)
+	{
+		case NetClient::connected:
+			++m_stats.connected;
+			m_connected = true;
+
+			if (!m_options.login)
+			{
+				cli::Init_Init init;
+				init.challenge = 10000 + m_index;
+				init.version = {0, 0, 28};
+				init.hdid = "eoref-loadgen";
+				m_client.send_packet(init);
+			}
+
+			break;
+
+		case NetClient::ready:
+			++m_stats.ready;
+
+			if (!m_options.login)
+				enter_game();
+
+			break;
+
+		case NetClient::disconnected:
+			if (m_stage == stage_connecting && !m_connected)
+			{
+				++m_stats.failed;
+				m_stats.last_failure = "connect failed";
+			}
+			else if (m_stage != stage_done)
+			{
+				++m_stats.disconnected;
+			}
+
+			m_stage = stage_done;
+			m_timer.cancel();
+			break;
+
+		default:
+			break;
+	}
+
+	if (m_options.login)
+		m_login.handle_state(state);
+}
+
+void Load_Session::handle_welcome(const srv::Welcome_Reply& reply)
+{
+	// Starting position, which the login sequence doesn't keep
+	if (reply.welcome_code == eo_protocol::WelcomeCode::EnterGame)
+	{
+		for (auto&& character : reply.u.enter_game.nearby.characters)
+		{
+			if (character.id == m_login.player_id())
+			{
+				m_x = character.coords.x;
+				m_y = character.coords.y;
+			}
+		}
+	}
+
+	m_login.handle_packet(reply);
+}
+
+void Load_Session::enter_game()
+{
+	auto now = clock::now();
+
+	m_stage = stage_in_game;
+	++m_stats.in_game;
+
+	{
+		auto login_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_connect_time);
+
+		std::unique_lock lock(m_stats.login_mutex);
+		m_stats.login_hist.add(std::uint64_t(login_ns.count()));
+	}
+
+	// Spread sessions across the interval so they don't act in lock-step
+	auto spread = [this](std::chrono::milliseconds interval)
+	{
+		return interval * (m_index % 16) / 16;
+	};
+
+	m_next_walk = now + spread(m_options.walk_interval);
+	m_next_chat = now + spread(m_options.chat_interval);
+
+	schedule_action();
+}
+
+void Load_Session::schedule_action()
+{
+	if (m_stage != stage_in_game)
+		return;
+
+	auto next = clock::time_point::max();
+
+	if (m_options.walk_interval.count() > 0)
+		next = std::min(next, m_next_walk);
+
+	if (m_options.chat_interval.count() > 0)
+		next = std::min(next, m_next_chat);
+
+	if (next == clock::time_point::max())
+		return;
+
+	m_timer.expires_at(next);
+	m_timer.async_wait([this](const asio::error_code& error)
+	{
+		if (error)
+			return;
+
+		m_client.dispatch([this]()
+		{
+			act();
+			schedule_action();
+		});
+	});
+}
+
+void Load_Session::act()
+{
+	if (m_stage != stage_in_game)
+		return;
+
+	auto now = clock::now();
+
+	if (m_options.walk_interval.count() > 0 && now >= m_next_walk)
+	{
+		// Walks a 4x4 square around the starting position
+		static constexpr eo_protocol::Direction pattern[4] = {
+			eo_protocol::Direction::Right,
+			eo_protocol::Direction::Down,
+			eo_protocol::Direction::Left,
+			eo_protocol::Direction::Up
+		};
+
+		auto direction = pattern[(m_step++ / 4) % 4];
+
+		switch (direction)
+		{
+			case eo_protocol::Direction::Right: ++m_x; break;
+			case eo_protocol::Direction::Down:  ++m_y; break;
+			case eo_protocol::Direction::Left:  --m_x; break;
+			case eo_protocol::Direction::Up:    --m_y; break;
+		}
+
+		auto centiseconds = std::chrono::duration_cast<std::chrono::milliseconds>(
+			now.time_since_epoch()).count() / 10;
+
+		cli::Walk_Player walk;
+		walk.walk.direction = direction;
+		walk.walk.timestamp = eo_three(centiseconds % 16000000);
+		walk.walk.coords.x = eo_char(m_x);
+		walk.walk.coords.y = eo_char(m_y);
+		m_client.send_packet(walk);
+
+		++m_stats.walks;
+		m_next_walk += m_options.walk_interval;
+	}
+
+	if (m_options.chat_interval.count() > 0 && now >= m_next_chat)
+	{
+		cli::Talk_Report talk;
+		talk.message = "loadgen " + std::to_string(m_index) + " " + std::to_string(m_chat_count++);
+		m_client.send_packet(talk);
+
+		++m_stats.chats;
+		m_next_chat += m_options.chat_interval;
+	}
+}
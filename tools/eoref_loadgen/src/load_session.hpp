@@ -0,0 +1,106 @@
+#ifndef EO_LOAD_SESSION_HPP
+#define EO_LOAD_SESSION_HPP
+
+#include "login_sequence.hpp"
+#include "net_telemetry.hpp"
+#include "netclient.hpp"
+
+#include <asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct Load_Options
+{
+	std::string host = "127.0.0.1";
+	std::string port = "8078";
+
+	// Logs in and enters the game before walking
+	// When false, Login_Request / Welcome_* are skipped and walking starts once the handshake completes
+	bool login = true;
+	std::string username_prefix = "bot";
+	std::string password = "password";
+
+	std::chrono::milliseconds walk_interval{500};
+	std::chrono::milliseconds chat_interval{5000};
+	std::chrono::milliseconds ping_interval{1000};
+};
+
+// Shared between every session, updated from the io_context threads
+struct Load_Stats
+{
+	std::atomic<std::uint64_t> connected = 0;
+	std::atomic<std::uint64_t> ready = 0;
+	std::atomic<std::uint64_t> in_game = 0;
+	std::atomic<std::uint64_t> failed = 0;
+	std::atomic<std::uint64_t> disconnected = 0;
+	std::atomic<std::uint64_t> walks = 0;
+	std::atomic<std::uint64_t> chats = 0;
+
+	// Most recent reason passed to Load_Session::fail
+	std::atomic<const char*> last_failure = nullptr;
+
+	// Time from connect() to entering the game
+	std::mutex login_mutex;
+	Net_Telemetry::Histogram login_hist;
+};
+
+class Load_Session
+{
+	private:
+		using clock = std::chrono::steady_clock;
+
+		enum stage_t
+		{
+			stage_idle,
+			stage_connecting,
+			stage_in_game,
+			stage_done
+		};
+
+		const Load_Options& m_options;
+		Load_Stats& m_stats;
+		int m_index;
+
+		NetClient m_client;
+		Login_Sequence m_login;
+		asio::steady_timer m_timer;
+
+		stage_t m_stage = stage_idle;
+		bool m_connected = false;
+		clock::time_point m_connect_time;
+		clock::time_point m_next_walk;
+		clock::time_point m_next_chat;
+
+		int m_x = 0;
+		int m_y = 0;
+		int m_step = 0;
+		int m_chat_count = 0;
+
+		void handle_state(NetClient::state_t state);
+		void handle_welcome(const srv::Welcome_Reply& reply);
+
+		void fail(const char* reason);
+		void enter_game();
+
+		void schedule_action();
+		void act();
+
+	public:
+		Load_Session(asio::io_context& io_ctx, const Load_Options& options,
+		             Load_Stats& stats, int index);
+
+		// no copy/move/assign
+		Load_Session(const Load_Session&) = delete;
+		const Load_Session& operator=(const Load_Session&) = delete;
+
+		void start();
+		void stop();
+
+		Net_Telemetry::Snapshot telemetry() const;
+};
+
+#endif // EO_LOAD_SESSION_HPP
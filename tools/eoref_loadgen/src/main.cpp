@@ -0,0 +1,260 @@
+// Headless load generator: many NetClient sessions sharing one io_context
+
+#include "load_session.hpp"
+
+#include "packet/eo_packets.hpp"
+
+#include "fmt/core.h"
+
+#include <asio.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+static void usage()
+{
+	std::fputs(
+		"usage: eoref_loadgen [options]\n"
+		"  -host HOST      server address (default 127.0.0.1)\n"
+		"  -port PORT      server port (default 8078)\n"
+		"  -sessions N     number of concurrent sessions (default 10)\n"
+		"  -threads N      io_context threads (default hardware concurrency)\n"
+		"  -ramp MS        delay between session starts (default 10)\n"
+		"  -duration S     seconds to run once every session has started (default 30)\n"
+		"  -nologin        skip login and character selection after the handshake\n"
+		"  -user PREFIX    account name prefix, suffixed with the session index (default bot)\n"
+		"  -pass PASSWORD  account password (default password)\n"
+		"  -walk MS        walk interval, 0 disables (default 500)\n"
+		"  -chat MS        chat interval, 0 disables (default 5000)\n"
+		"  -ping MS        latency probe interval, 0 disables (default 1000)\n",
+		stderr
+	);
+}
+
+static std::string packet_name(unsigned id)
+{
+	auto family = eo_protocol::PacketFamily(id >> 8);
+	auto action = eo_protocol::PacketAction(id & 0xFF);
+
+	return fmt::format("{}_{}", eo_protocol::name(family), eo_protocol::name(action));
+}
+
+static void print_table(const char* title, const Net_Telemetry::Stats_Table& table, double seconds)
+{
+	fmt::print("\n{:<32} {:>10} {:>10} {:>12} {:>10}\n", title, "packets", "pkt/s", "bytes", "p99 us");
+
+	for (auto&& [id, stats] : table)
+	{
+		fmt::print("{:<32} {:>10} {:>10.1f} {:>12} {:>10.1f}\n", packet_name(id),
+		           stats.packets, stats.packets / seconds, stats.bytes,
+		           stats.decode_hist.percentile(99.0) / 1000.0);
+	}
+}
+
+static void print_progress(const Load_Stats& stats, int started)
+{
+	fmt::print("started {:>5}  connected {:>5}  ready {:>5}  in game {:>5}  failed {:>5}  dropped {:>5}  walks {:>8}  chats {:>6}\n",
+	           started, stats.connected.load(), stats.ready.load(), stats.in_game.load(),
+	           stats.failed.load(), stats.disconnected.load(), stats.walks.load(), stats.chats.load());
+}
+
+int main(int argc, char** argv)
+{
+	Load_Options options;
+	int session_count = 10;
+	int thread_count = std::max(1u, std::thread::hardware_concurrency());
+	std::chrono::milliseconds ramp{10};
+	std::chrono::seconds duration{30};
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+
+		if (std::strcmp(arg, "-nologin") == 0)
+		{
+			options.login = false;
+			continue;
+		}
+
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+		if (!value)
+		{
+			usage();
+			return 1;
+		}
+
+		if (std::strcmp(arg, "-host") == 0)
+			options.host = value;
+		else if (std::strcmp(arg, "-port") == 0)
+			options.port = value;
+		else if (std::strcmp(arg, "-sessions") == 0)
+			session_count = std::atoi(value);
+		else if (std::strcmp(arg, "-threads") == 0)
+			thread_count = std::atoi(value);
+		else if (std::strcmp(arg, "-ramp") == 0)
+			ramp = std::chrono::milliseconds(std::atoi(value));
+		else if (std::strcmp(arg, "-duration") == 0)
+			duration = std::chrono::seconds(std::atoi(value));
+		else if (std::strcmp(arg, "-user") == 0)
+			options.username_prefix = value;
+		else if (std::strcmp(arg, "-pass") == 0)
+			options.password = value;
+		else if (std::strcmp(arg, "-walk") == 0)
+			options.walk_interval = std::chrono::milliseconds(std::atoi(value));
+		else if (std::strcmp(arg, "-chat") == 0)
+			options.chat_interval = std::chrono::milliseconds(std::atoi(value));
+		else if (std::strcmp(arg, "-ping") == 0)
+			options.ping_interval = std::chrono::milliseconds(std::atoi(value));
+		else
+		{
+			usage();
+			return 1;
+		}
+
+		++i;
+	}
+
+	if (session_count <= 0 || thread_count <= 0)
+	{
+		usage();
+		return 1;
+	}
+
+	asio::io_context io_ctx(thread_count);
+	auto work = asio::make_work_guard(io_ctx);
+
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < thread_count; ++i)
+		threads.emplace_back([&io_ctx]() { io_ctx.run(); });
+
+	Load_Stats stats;
+	std::vector<std::unique_ptr<Load_Session>> sessions;
+	sessions.reserve(session_count);
+
+	using clock = std::chrono::steady_clock;
+
+	auto start_time = clock::now();
+	auto next_progress = start_time + std::chrono::seconds(1);
+
+	for (int i = 0; i < session_count; ++i)
+	{
+		sessions.push_back(std::make_unique<Load_Session>(io_ctx, options, stats, i));
+		sessions.back()->start();
+
+		if (ramp.count() > 0)
+			std::this_thread::sleep_for(ramp);
+
+		if (clock::now() >= next_progress)
+		{
+			print_progress(stats, i + 1);
+			next_progress += std::chrono::seconds(1);
+		}
+	}
+
+	auto end_time = clock::now() + duration;
+
+	while (clock::now() < end_time)
+	{
+		std::this_thread::sleep_until(std::min(next_progress, end_time));
+
+		if (clock::now() >= next_progress)
+		{
+			print_progress(stats, session_count);
+			next_progress += std::chrono::seconds(1);
+		}
+	}
+
+	auto stop_time = clock::now();
+
+	std::vector<Net_Telemetry::Snapshot> snapshots;
+	snapshots.reserve(sessions.size());
+
+	for (auto&& session : sessions)
+		snapshots.push_back(session->telemetry());
+
+	for (auto&& session : sessions)
+		session->stop();
+
+	work.reset();
+
+	// Give the sessions a moment to close before the context is torn down
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	io_ctx.stop();
+
+	for (auto&& thread : threads)
+		thread.join();
+
+	sessions.clear();
+
+	double seconds = std::chrono::duration<double>(stop_time - start_time).count();
+
+	Net_Telemetry::Stats_Table incoming;
+	Net_Telemetry::Stats_Table outgoing;
+	std::vector<double> srtts;
+	std::uint64_t packets_in = 0, bytes_in = 0;
+	std::uint64_t packets_out = 0, bytes_out = 0;
+
+	for (auto&& snapshot : snapshots)
+	{
+		for (auto&& [id, packet_stats] : snapshot.incoming)
+		{
+			incoming[id] += packet_stats;
+			packets_in += packet_stats.packets;
+			bytes_in += packet_stats.bytes;
+		}
+
+		for (auto&& [id, packet_stats] : snapshot.outgoing)
+		{
+			outgoing[id] += packet_stats;
+			packets_out += packet_stats.packets;
+			bytes_out += packet_stats.bytes;
+		}
+
+		if (snapshot.latency.samples > 0)
+			srtts.push_back(snapshot.latency.srtt_ms);
+	}
+
+	fmt::print("\n{} sessions on {} threads, {:.1f} s\n", session_count, thread_count, seconds);
+	print_progress(stats, session_count);
+
+	if (const char* reason = stats.last_failure.load())
+		fmt::print("last failure: {}\n", reason);
+
+	fmt::print("\nin:  {:.1f} packets/s, {:.1f} KB/s\n", packets_in / seconds, bytes_in / seconds / 1024.0);
+	fmt::print("out: {:.1f} packets/s, {:.1f} KB/s\n", packets_out / seconds, bytes_out / seconds / 1024.0);
+
+	{
+		std::unique_lock lock(stats.login_mutex);
+
+		if (stats.in_game > 0)
+		{
+			fmt::print("\nconnect to in game (ms): p50 {:.2f}  p90 {:.2f}  p99 {:.2f}\n",
+			           stats.login_hist.percentile(50.0) / 1e6,
+			           stats.login_hist.percentile(90.0) / 1e6,
+			           stats.login_hist.percentile(99.0) / 1e6);
+		}
+	}
+
+	if (!srtts.empty())
+	{
+		std::sort(srtts.begin(), srtts.end());
+
+		auto at = [&](double p)
+		{
+			return srtts[std::min(srtts.size() - 1, std::size_t(p / 100.0 * srtts.size()))];
+		};
+
+		fmt::print("session srtt (ms): min {:.2f}  p50 {:.2f}  p90 {:.2f}  p99 {:.2f}  max {:.2f}\n",
+		           srtts.front(), at(50.0), at(90.0), at(99.0), srtts.back());
+	}
+
+	print_table("incoming", incoming, seconds);
+	print_table("outgoing", outgoing, seconds);
+}
@@ -0,0 +1,90 @@
+// Minimal EOSERV stand-in for running the client and network tools offline
+
+#include "mock_server.hpp"
+
+#include <asio.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage()
+{
+	std::fputs(
+		"usage: eoref_mockserv [options]\n"
+		"  -port N         listen port (default 8078)\n"
+		"  -data DIR       directory containing maps/ and pub/ (default .)\n"
+		"  -map N          map served for Welcome_Agree requests (default 1)\n"
+		"  -keepalive MS   Connection_Player interval, 0 disables (default 60000)\n"
+		"  -script FILE    world updates, one \"<interval_ms> <hex bytes>\" per line\n"
+		"  -rate X         multiplier for every script entry's rate (default 1)\n",
+		stderr
+	);
+}
+
+int main(int argc, char** argv)
+{
+	Mock_Config config;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+		if (!value)
+		{
+			usage();
+			return 1;
+		}
+
+		if (std::strcmp(arg, "-port") == 0)
+		{
+			config.port = value;
+		}
+		else if (std::strcmp(arg, "-data") == 0)
+		{
+			config.data_dir = value;
+		}
+		else if (std::strcmp(arg, "-map") == 0)
+		{
+			config.map_id = std::atoi(value);
+		}
+		else if (std::strcmp(arg, "-keepalive") == 0)
+		{
+			config.keepalive = std::chrono::milliseconds(std::atoi(value));
+		}
+		else if (std::strcmp(arg, "-script") == 0)
+		{
+			if (!load_mock_script(value, config.script))
+			{
+				std::fprintf(stderr, "Could not load script %s\n", value);
+				return 1;
+			}
+		}
+		else if (std::strcmp(arg, "-rate") == 0)
+		{
+			config.script_rate = std::atof(value);
+
+			if (config.script_rate <= 0.0)
+			{
+				usage();
+				return 1;
+			}
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+
+		++i;
+	}
+
+	asio::io_context io_ctx;
+	Mock_Server server(io_ctx, std::move(config));
+
+	if (!server.listen())
+		return 1;
+
+	io_ctx.run();
+}
@@ -0,0 +1,641 @@
+#include "mock_server.hpp"
+
+#include "cio/cio.hpp"
+#include "data/eo_stream.hpp"
+#include "packet/eo_packets.hpp"
+#include "packet/packet_processor.hpp"
+
+#include "trace.hpp"
+
+#include "fmt/core.h"
+
+#include <cctype>
+#include <deque>
+#include <random>
+#include <utility>
+
+using tcp = asio::ip::tcp;
+
+#define TRACE_CTX "mockserv"
+
+static std::shared_ptr<Client_Packet> unserialize_client(EO_Stream_Reader& reader)
+{
+	if (reader.remaining() < 2)
+		return nullptr;
+
+	auto action = PacketAction(reader.get_byte());
+	auto family = PacketFamily(reader.get_byte());
+
+	auto id = packet_id_hash(PacketID{family, action});
+
+	// Every packet but Init_Init carries a sequence byte
+	// The sequence start handed out by the server always keeps it to one byte
+	if (id != packet_id_hash(cli::Init_Init::id))
+		reader.get_char();
+
+#define case_packet(type) \
+	case packet_id_hash(client::type::id): \
+	{ \
+		auto p = std::make_shared<client::type>(); \
+		p->unserialize(reader); \
+		return p; \
+	}
+
+	using namespace eo_protocol;
+
+	switch (id)
+	{
+#include "eo_protocol/client_packets.tpp"
+	}
+
+#undef case_packet
+
+	return nullptr;
+}
+
+bool load_mock_script(const std::string& filename, std::vector<Mock_Script_Entry>& script)
+{
+	cio::stream f(filename.c_str(), cio::stream::mode_read | cio::stream::mode_text);
+
+	if (!f)
+		return false;
+
+	std::string line;
+	char c;
+
+	auto hex_value = [](char c) -> int
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	};
+
+	auto parse_line = [&]()
+	{
+		auto comment = line.find('#');
+
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::size_t pos = 0;
+		long interval = 0;
+
+		while (pos < line.size() && std::isspace(eo_byte(line[pos])))
+			++pos;
+
+		if (pos == line.size())
+			return true;
+
+		while (pos < line.size() && std::isdigit(eo_byte(line[pos])))
+			interval = interval * 10 + (line[pos++] - '0');
+
+		Mock_Script_Entry entry{std::chrono::milliseconds(interval), {}};
+		int nibble = -1;
+
+		for (; pos < line.size(); ++pos)
+		{
+			if (std::isspace(eo_byte(line[pos])))
+				continue;
+
+			int value = hex_value(line[pos]);
+
+			if (value < 0)
+				return false;
+
+			if (nibble < 0)
+			{
+				nibble = value;
+			}
+			else
+			{
+				entry.payload += char((nibble << 4) | value);
+				nibble = -1;
+			}
+		}
+
+		if (interval <= 0 || nibble >= 0 || entry.payload.size() < 2)
+			return false;
+
+		script.push_back(std::move(entry));
+		return true;
+	};
+
+	while (f.get(c))
+	{
+		if (c != '\n')
+		{
+			line += c;
+			continue;
+		}
+
+		if (!parse_line())
+			return false;
+
+		line.clear();
+	}
+
+	return parse_line();
+}
+
+class Mock_Server::session_t : public std::enable_shared_from_this<session_t>
+{
+	private:
+		Mock_Server& m_server;
+		tcp::socket m_socket;
+
+		std::array<char, 2> m_read_header;
+		std::vector<char> m_read_buffer;
+
+		Packet_Processor m_processor;
+		bool m_initialized = false;
+		int m_player_id;
+
+		std::deque<std::string> m_write_queue;
+
+		asio::steady_timer m_keepalive_timer;
+		std::vector<std::unique_ptr<asio::steady_timer>> m_script_timers;
+
+		std::minstd_rand m_rng;
+
+		int random(int min, int max)
+		{
+			return std::uniform_int_distribution<int>(min, max)(m_rng);
+		}
+
+		void close()
+		{
+			if (!m_socket.is_open())
+				return;
+
+			trace_log("player " << m_player_id << " disconnected");
+
+			asio::error_code ec;
+			m_socket.close(ec);
+			m_keepalive_timer.cancel();
+
+			for (auto&& timer : m_script_timers)
+				timer->cancel();
+		}
+
+		void do_read_header()
+		{
+			asio::async_read(m_socket, asio::buffer(m_read_header),
+				[this, self = shared_from_this()](const asio::error_code& error, std::size_t)
+				{
+					if (error)
+					{
+						close();
+						return;
+					}
+
+					unsigned length = eo_number_decode(eo_byte(m_read_header[0]),
+					                                   eo_byte(m_read_header[1]));
+
+					if (length < 2)
+					{
+						trace_log("bad packet length " << length);
+						close();
+						return;
+					}
+
+					m_read_buffer.resize(length);
+					do_read_body();
+				}
+			);
+		}
+
+		void do_read_body()
+		{
+			asio::async_read(m_socket, asio::buffer(m_read_buffer),
+				[this, self = shared_from_this()](const asio::error_code& error, std::size_t)
+				{
+					if (error)
+					{
+						close();
+						return;
+					}
+
+					m_processor.decode(m_read_buffer.data(), m_read_buffer.size());
+
+					EO_Stream_Reader reader({m_read_buffer.data(), m_read_buffer.size()});
+					auto packet = unserialize_client(reader);
+
+					if (packet)
+					{
+						handle_packet(*packet);
+					}
+					else
+					{
+						auto action = PacketAction(eo_byte(m_read_buffer[0]));
+						auto family = PacketFamily(eo_byte(m_read_buffer[1]));
+
+						trace_log("ignoring unknown packet " << name(family) << "_" << name(action));
+					}
+
+					do_read_header();
+				}
+			);
+		}
+
+		void do_write()
+		{
+			asio::async_write(m_socket, asio::buffer(m_write_queue.front()),
+				[this, self = shared_from_this()](const asio::error_code& error, std::size_t)
+				{
+					if (error)
+					{
+						close();
+						return;
+					}
+
+					m_write_queue.pop_front();
+
+					if (!m_write_queue.empty())
+						do_write();
+				}
+			);
+		}
+
+		// data starts with the action and family bytes
+		void send_raw(std::string data)
+		{
+			if (!m_socket.is_open())
+				return;
+
+			auto length = eo_encode_number(unsigned(data.size()));
+			data.insert(0, {char(length[0]), char(length[1])});
+
+			m_processor.encode(&data[2], data.size() - 2);
+
+			m_write_queue.push_back(std::move(data));
+
+			if (m_write_queue.size() == 1)
+				do_write();
+		}
+
+		template <class T>
+		void send(const T& packet)
+		{
+			EO_Stream_Builder builder(packet.byte_size() + 2);
+
+			builder.add_byte(eo_byte(T::action));
+			builder.add_byte(eo_byte(T::family));
+			packet.serialize(builder);
+
+			send_raw(std::move(builder.get()));
+		}
+
+		void send_file(eo_protocol::InitReply reply_code, const std::string& path)
+		{
+			auto&& content = m_server.file(path);
+
+			srv::Init_Init reply;
+			reply.reply_code = reply_code;
+
+			// The union member matching reply_code must be constructed before use
+			switch (reply_code)
+			{
+				case eo_protocol::InitReply::File_Map:
+					new(&reply.u.file_map) decltype(reply.u.file_map){content};
+					break;
+
+				case eo_protocol::InitReply::File_EIF:
+					new(&reply.u.file_eif) decltype(reply.u.file_eif){1, content};
+					break;
+
+				case eo_protocol::InitReply::File_ENF:
+					new(&reply.u.file_enf) decltype(reply.u.file_enf){1, content};
+					break;
+
+				case eo_protocol::InitReply::File_ESF:
+					new(&reply.u.file_esf) decltype(reply.u.file_esf){1, content};
+					break;
+
+				case eo_protocol::InitReply::File_ECF:
+					new(&reply.u.file_ecf) decltype(reply.u.file_ecf){1, content};
+					break;
+
+				default:
+					return;
+			}
+
+			send(reply);
+
+			trace_log("sent " << path << " (" << content.size() << " bytes)");
+		}
+
+		// The 4 byte hash follows the file's magic number in every map and pub format
+		std::array<eo_byte, 4> file_hash(const std::string& path)
+		{
+			auto&& content = m_server.file(path);
+			std::array<eo_byte, 4> hash = {};
+
+			if (content.size() >= 7)
+			{
+				for (std::size_t i = 0; i < hash.size(); ++i)
+					hash[i] = eo_byte(content[3 + i]);
+			}
+
+			return hash;
+		}
+
+		std::string map_path() const
+		{
+			return fmt::format("maps/{:05}.emf", m_server.m_config.map_id);
+		}
+
+		void handle_login(const cli::Login_Request& packet)
+		{
+			// Every account has one character, named after the account
+			srv::Login_Reply reply;
+			reply.reply_code = eo_protocol::LoginReply::OK;
+			new(&reply.u.ok) decltype(reply.u.ok){};
+
+			auto&& character_list = reply.u.ok.character_list;
+			character_list.characters.push_back({});
+			character_list.characters.back().name = packet.username;
+			character_list.characters.back().id = m_player_id;
+			character_list.num_characters = 1;
+
+			send(reply);
+		}
+
+		void handle_welcome_request(const cli::Welcome_Request& packet)
+		{
+			srv::Welcome_Reply reply;
+			reply.welcome_code = eo_protocol::WelcomeCode::SelectCharacter;
+			new(&reply.u.select_character) decltype(reply.u.select_character){};
+
+			auto&& select = reply.u.select_character;
+			select.player_Id = eo_short(m_player_id);
+			select.character_id = packet.character_id;
+			select.map_id = eo_short(m_server.m_config.map_id);
+			select.map_hash = file_hash(map_path());
+			select.map_filename = eo_three(m_server.file(map_path()).size());
+			select.eif_hash = file_hash("pub/dat001.eif");
+			select.enf_hash = file_hash("pub/dtn001.enf");
+			select.esf_hash = file_hash("pub/dsl001.esf");
+			select.ecf_hash = file_hash("pub/dat001.ecf");
+			select.name = fmt::format("mock{}", m_player_id);
+			select.level = 1;
+
+			send(reply);
+		}
+
+		void handle_welcome_msg(const cli::Welcome_Msg& packet)
+		{
+			srv::Welcome_Reply reply;
+			reply.welcome_code = eo_protocol::WelcomeCode::EnterGame;
+			new(&reply.u.enter_game) decltype(reply.u.enter_game){};
+
+			auto&& nearby = reply.u.enter_game.nearby;
+			nearby.characters.push_back({});
+			nearby.characters.back().name = fmt::format("mock{}", m_player_id);
+			nearby.characters.back().id = eo_short(m_player_id);
+			nearby.characters.back().map_id = eo_short(m_server.m_config.map_id);
+			nearby.characters.back().coords.x = 10;
+			nearby.characters.back().coords.y = 10;
+			nearby.num_characters = 1;
+
+			send(reply);
+		}
+
+		void handle_init(const cli::Init_Init& packet)
+		{
+			eo_byte multi_d = eo_byte(random(6, 12));
+			eo_byte multi_e = eo_byte(random(6, 12));
+
+			// Kept low so that the client always sends a single sequence byte
+			unsigned seq_start = unsigned(random(10, 200));
+
+			srv::Init_Init reply;
+			reply.reply_code = eo_protocol::InitReply::OK;
+			new(&reply.u.ok) decltype(reply.u.ok);
+			reply.u.ok.seq_bytes = {eo_byte((seq_start + 13) / 7), eo_byte((seq_start + 13) % 7)};
+			reply.u.ok.multi = {multi_d, multi_e};
+			reply.u.ok.player_id = eo_short(m_player_id);
+			reply.u.ok.response = cli::Init_Init::stupid_hash(packet.challenge);
+
+			send(reply);
+
+			// The client decodes with multi[0] and encodes with multi[1]
+			m_processor.set_multi(multi_e, multi_d);
+			m_initialized = true;
+
+			trace_log("player " << m_player_id << " initialized");
+
+			schedule_keepalive();
+			start_script();
+		}
+
+		void handle_packet(Client_Packet& packet)
+		{
+			auto id = packet.vid();
+
+			if (!m_initialized)
+			{
+				if (id == cli::Init_Init::id)
+					handle_init(packet.as<cli::Init_Init>());
+
+				return;
+			}
+
+			if (id == cli::Message_Ping::id)
+			{
+				srv::Message_Pong pong;
+				pong.something = packet.as<cli::Message_Ping>().something;
+				send(pong);
+			}
+			else if (id == cli::Players_Accept::id)
+			{
+				// #find always reports the player as offline
+				srv::Players_Ping reply;
+				reply.name = packet.as<cli::Players_Accept>().name;
+				send(reply);
+			}
+			else if (id == cli::Login_Request::id)
+			{
+				handle_login(packet.as<cli::Login_Request>());
+			}
+			else if (id == cli::Welcome_Request::id)
+			{
+				handle_welcome_request(packet.as<cli::Welcome_Request>());
+			}
+			else if (id == cli::Welcome_Msg::id)
+			{
+				handle_welcome_msg(packet.as<cli::Welcome_Msg>());
+			}
+			else if (id == cli::Welcome_Agree::id)
+			{
+				using eo_protocol::FileType;
+				using eo_protocol::InitReply;
+
+				switch (packet.as<cli::Welcome_Agree>().file_type)
+				{
+					case FileType::Map:
+						send_file(InitReply::File_Map, map_path());
+						break;
+
+					case FileType::Item:  send_file(InitReply::File_EIF, "pub/dat001.eif"); break;
+					case FileType::NPC:   send_file(InitReply::File_ENF, "pub/dtn001.enf"); break;
+					case FileType::Spell: send_file(InitReply::File_ESF, "pub/dsl001.esf"); break;
+					case FileType::Class: send_file(InitReply::File_ECF, "pub/dat001.ecf"); break;
+				}
+			}
+		}
+
+		void schedule_keepalive()
+		{
+			if (m_server.m_config.keepalive.count() <= 0)
+				return;
+
+			m_keepalive_timer.expires_after(m_server.m_config.keepalive);
+			m_keepalive_timer.async_wait(
+				[this, self = shared_from_this()](const asio::error_code& error)
+				{
+					if (error)
+						return;
+
+					unsigned seq_start = unsigned(random(10, 200));
+					unsigned seq2 = unsigned(random(0, 200));
+
+					srv::Connection_Player ping;
+					ping.seq1 = eo_short(seq_start + seq2);
+					ping.seq2 = eo_char(seq2);
+					send(ping);
+
+					schedule_keepalive();
+				}
+			);
+		}
+
+		void schedule_script_entry(std::size_t i)
+		{
+			auto&& entry = m_server.m_config.script[i];
+			auto&& timer = *m_script_timers[i];
+
+			auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				entry.interval / m_server.m_config.script_rate);
+
+			timer.expires_at(timer.expiry() + interval);
+			timer.async_wait(
+				[this, self = shared_from_this(), i](const asio::error_code& error)
+				{
+					if (error)
+						return;
+
+					send_raw(m_server.m_config.script[i].payload);
+					schedule_script_entry(i);
+				}
+			);
+		}
+
+		void start_script()
+		{
+			auto&& script = m_server.m_config.script;
+
+			for (std::size_t i = 0; i < script.size(); ++i)
+			{
+				m_script_timers.push_back(std::make_unique<asio::steady_timer>(
+					m_socket.get_executor(), std::chrono::steady_clock::now()));
+
+				schedule_script_entry(i);
+			}
+		}
+
+	public:
+		session_t(Mock_Server& server, tcp::socket socket, int player_id)
+			: m_server(server)
+			, m_socket(std::move(socket))
+			, m_player_id(player_id)
+			, m_keepalive_timer(m_socket.get_executor())
+			, m_rng(std::random_device{}())
+		{ }
+
+		void start()
+		{
+			trace_log("player " << m_player_id << " connected");
+			do_read_header();
+		}
+};
+
+Mock_Server::Mock_Server(asio::io_context& io_ctx, Mock_Config config)
+	: m_io_ctx(io_ctx)
+	, m_acceptor(io_ctx)
+	, m_config(std::move(config))
+{ }
+
+Mock_Server::~Mock_Server()
+{ }
+
+bool Mock_Server::listen()
+{
+	asio::error_code ec;
+	tcp::endpoint endpoint(tcp::v4(), eo_short(std::atoi(m_config.port.c_str())));
+
+	m_acceptor.open(endpoint.protocol(), ec);
+
+	if (!ec)
+		m_acceptor.set_option(tcp::acceptor::reuse_address(true), ec);
+
+	if (!ec)
+		m_acceptor.bind(endpoint, ec);
+
+	if (!ec)
+		m_acceptor.listen(asio::socket_base::max_listen_connections, ec);
+
+	if (ec)
+	{
+		trace_log("could not listen on port " << m_config.port << ": " << ec.message());
+		return false;
+	}
+
+	trace_log("listening on port " << m_config.port);
+
+	do_accept();
+	return true;
+}
+
+void Mock_Server::do_accept()
+{
+	m_acceptor.async_accept(
+		[this](const asio::error_code& error, tcp::socket socket)
+		{
+			if (!error)
+			{
+				socket.set_option(tcp::no_delay(true));
+				std::make_shared<session_t>(*this, std::move(socket), m_next_player_id++)->start();
+			}
+
+			do_accept();
+		}
+	);
+}
+
+const std::string& Mock_Server::file(const std::string& path)
+{
+	auto it = m_file_cache.find(path);
+
+	if (it != m_file_cache.end())
+		return it->second;
+
+	std::string content;
+	auto full_path = m_config.data_dir + "/" + path;
+	cio::stream f(full_path.c_str());
+
+	if (f)
+	{
+		char buf[4096];
+		std::size_t n;
+
+		while ((n = f.read(buf, sizeof buf)) > 0)
+			content.append(buf, n);
+	}
+	else
+	{
+		trace_log("missing data file " << full_path << ", serving an empty file");
+	}
+
+	return m_file_cache.emplace(path, std::move(content)).first->second;
+}
@@ -0,0 +1,70 @@
+#ifndef EO_MOCK_SERVER_HPP
+#define EO_MOCK_SERVER_HPP
+
+#include <asio.hpp>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Stand-in for EOSERV covering enough of the protocol for loopback tests
+
+struct Mock_Script_Entry
+{
+	std::chrono::milliseconds interval;
+
+	// Unencoded packet data, starting with the action and family bytes
+	std::string payload;
+};
+
+struct Mock_Config
+{
+	std::string port = "8078";
+
+	// Files are served from maps/NNNNN.emf and pub/*.e?f under this directory
+	std::string data_dir = ".";
+	int map_id = 1;
+
+	// Interval between Connection_Player sequence updates, zero disables
+	std::chrono::milliseconds keepalive{60000};
+
+	// Multiplier applied to the rate of every script entry
+	double script_rate = 1.0;
+	std::vector<Mock_Script_Entry> script;
+};
+
+// Lines are "<interval_ms> <hex bytes>", blank lines and #-comments are ignored
+bool load_mock_script(const std::string& filename, std::vector<Mock_Script_Entry>& script);
+
+class Mock_Server
+{
+	private:
+		class session_t;
+
+		asio::io_context& m_io_ctx;
+		asio::ip::tcp::acceptor m_acceptor;
+		Mock_Config m_config;
+
+		// Keyed by path relative to data_dir, loaded on first request
+		std::map<std::string, std::string> m_file_cache;
+
+		int m_next_player_id = 1;
+
+		void do_accept();
+
+		const std::string& file(const std::string& path);
+
+	public:
+		Mock_Server(asio::io_context& io_ctx, Mock_Config config);
+		~Mock_Server();
+
+		// no copy/move/assign
+		Mock_Server(const Mock_Server&) = delete;
+		const Mock_Server& operator=(const Mock_Server&) = delete;
+
+		bool listen();
+};
+
+#endif // EO_MOCK_SERVER_HPP
@@ -0,0 +1,270 @@
+// Replays a NetClient capture file through the client's incoming packet
+// pipeline without a server or display, and reports per-stage timings.
+
+#include "net_capture.hpp"
+#include "netclient.hpp"
+
+#include "cio/cio.hpp"
+#include "data/eo_stream.hpp"
+#include "packet/eo_packets.hpp"
+#include "packet/packet_processor.hpp"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+enum stage_t
+{
+	stage_decode,
+	stage_unserialize,
+	stage_handler,
+	stage_total,
+	stage_count
+};
+
+static constexpr const char* stage_names[stage_count] = {
+	"decode",
+	"unserialize",
+	"handler",
+	"total"
+};
+
+struct Replay_Stats
+{
+	std::uint64_t frames_in = 0;
+	std::uint64_t frames_out = 0;
+	std::uint64_t bytes_in = 0;
+	std::uint64_t unknown = 0;
+	std::uint64_t handled = 0;
+
+	std::array<std::vector<std::uint64_t>, stage_count> samples;
+};
+
+static std::uint64_t elapsed_ns(clock_type::time_point start, clock_type::time_point end)
+{
+	return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+static std::uint64_t percentile(const std::vector<std::uint64_t>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+
+	auto i = std::size_t(p / 100.0 * double(sorted.size() - 1) + 0.5);
+	return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static bool load_file(const char* filename, std::string& out)
+{
+	cio::stream f(filename);
+
+	if (!f)
+		return false;
+
+	char buf[65536];
+	std::size_t n;
+
+	while ((n = f.read(buf, sizeof buf)) > 0)
+		out.append(buf, n);
+
+	return !f.error();
+}
+
+static void replay(const std::vector<Net_Capture::Record>& records, NetClient& netclient,
+                   bool realtime, Replay_Stats& stats)
+{
+	Packet_Processor processor;
+	std::vector<char> frame;
+
+	auto replay_start = clock_type::now();
+	std::uint64_t first_ns = records.empty() ? 0 : records.front().time_ns;
+
+	for (auto&& record : records)
+	{
+		if (realtime)
+		{
+			auto offset = std::chrono::nanoseconds(record.time_ns - first_ns);
+			std::this_thread::sleep_until(replay_start + offset);
+		}
+
+		switch (record.type)
+		{
+			case Net_Capture::multi_change:
+				if (record.payload.size() >= 2)
+					processor.set_multi(eo_byte(record.payload[0]), eo_byte(record.payload[1]));
+				continue;
+
+			case Net_Capture::frame_out:
+				++stats.frames_out;
+				continue;
+
+			case Net_Capture::frame_in:
+				break;
+
+			default:
+				continue;
+		}
+
+		// Strip the length prefix, decoding happens in-place
+		if (record.payload.size() < 4)
+			continue;
+
+		frame.assign(record.payload.begin() + 2, record.payload.end());
+
+		++stats.frames_in;
+		stats.bytes_in += record.payload.size();
+
+		auto t0 = clock_type::now();
+
+		processor.decode(frame.data(), frame.size());
+
+		auto t1 = clock_type::now();
+
+		EO_Stream_Reader reader({frame.data(), frame.size()});
+		auto packet = eo_protocol::unserialize(reader);
+
+		auto t2 = clock_type::now();
+
+		if (packet)
+		{
+			netclient.deliver(*packet);
+			++stats.handled;
+		}
+		else
+		{
+			++stats.unknown;
+		}
+
+		auto t3 = clock_type::now();
+
+		stats.samples[stage_decode].push_back(elapsed_ns(t0, t1));
+		stats.samples[stage_unserialize].push_back(elapsed_ns(t1, t2));
+		stats.samples[stage_handler].push_back(elapsed_ns(t2, t3));
+		stats.samples[stage_total].push_back(elapsed_ns(t0, t3));
+	}
+}
+
+static void usage()
+{
+	std::fputs("usage: eoref_replay [-realtime] [-loop N] capture.eocap\n", stderr);
+}
+
+int main(int argc, char** argv)
+{
+	const char* input_filename = nullptr;
+	bool realtime = false;
+	int loops = 1;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+
+		if (std::strcmp(arg, "-realtime") == 0)
+		{
+			realtime = true;
+		}
+		else if (std::strcmp(arg, "-loop") == 0 && i + 1 < argc)
+		{
+			loops = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg[0] != '-' && !input_filename)
+		{
+			input_filename = arg;
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	if (!input_filename)
+	{
+		usage();
+		return 1;
+	}
+
+	std::string data;
+	std::vector<Net_Capture::Record> records;
+
+	if (!load_file(input_filename, data))
+	{
+		std::perror("Could not read capture file");
+		return 1;
+	}
+
+	if (!Net_Capture::parse(data, records))
+	{
+		std::fputs("Not a capture file\n", stderr);
+		return 1;
+	}
+
+	// Handlers subscribe to NetClient as they would in the client
+	NetClient netclient;
+	std::vector<std::uint64_t> type_counts(0x10000);
+
+	netclient.sig_incoming_packet.connect([&type_counts](Server_Packet& packet)
+	{
+		++type_counts[packet_id_hash(packet.vid())];
+	});
+
+	Replay_Stats stats;
+
+	auto start = clock_type::now();
+
+	for (int i = 0; i < loops; ++i)
+		replay(records, netclient, realtime, stats);
+
+	double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+	fmt::print("{} records, {} loop(s), {:.3f} s{}\n", records.size(), loops, seconds,
+	           realtime ? " (realtime)" : "");
+
+	fmt::print("frames in: {} ({} unknown), frames out: {}\n",
+	           stats.frames_in, stats.unknown, stats.frames_out);
+
+	if (seconds > 0.0)
+	{
+		fmt::print("throughput: {:.0f} frames/s, {:.2f} MB/s\n",
+		           double(stats.frames_in) / seconds,
+		           double(stats.bytes_in) / seconds / (1024.0 * 1024.0));
+	}
+
+	fmt::print("\n{:<12} {:>10} {:>10} {:>10} {:>10} {:>10}\n",
+	           "stage (ns)", "p50", "p90", "p99", "p99.9", "max");
+
+	for (int stage = 0; stage < stage_count; ++stage)
+	{
+		auto&& samples = stats.samples[stage];
+		std::sort(samples.begin(), samples.end());
+
+		fmt::print("{:<12} {:>10} {:>10} {:>10} {:>10} {:>10}\n", stage_names[stage],
+		           percentile(samples, 50.0), percentile(samples, 90.0),
+		           percentile(samples, 99.0), percentile(samples, 99.9),
+		           samples.empty() ? 0 : samples.back());
+	}
+
+	fmt::print("\n{:<32} {:>10}\n", "packet", "count");
+
+	for (std::size_t id = 0; id < type_counts.size(); ++id)
+	{
+		if (type_counts[id] == 0)
+			continue;
+
+		auto family = PacketFamily(id >> 8);
+		auto action = PacketAction(id & 0xFF);
+
+		fmt::print("{:<32} {:>10}\n", fmt::format("{}_{}", name(family), name(action)),
+		           type_counts[id]);
+	}
+}